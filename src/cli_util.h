@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lzss.h"
+#include "lzss_cache.h"
+
+// Helpers shared by the command-line tools (lzss_cli, ps1_cli).
+
+// Arguments are handled as UTF-8 on every platform; wmain converts on Windows.
+using Args = std::vector<std::string>;
+
+inline std::filesystem::path U8Path(const std::string& s) {
+    return std::filesystem::u8path(s);
+}
+inline std::string PathU8(const std::filesystem::path& p) {
+    return p.u8string();
+}
+
+// Applies a profile name; returns false if it is not recognised.
+inline bool ApplyProfile(const std::string& prof, LzssParams& params) {
+    params.optimal_parse = false;
+    params.matcher = LzssMatcher::HashChain;
+    if (prof == "rapido" || prof == "rápido") { params.bucket_limit = 64;  params.max_candidates = 128; }
+    else if (prof == "equilibrado") { params.bucket_limit = 128; params.max_candidates = 256; }
+    else if (prof == "maximo" || prof == "máximo" || prof == "maxima" || prof == "máxima") { params.bucket_limit = 256; params.max_candidates = 1024; }
+    else if (prof == "otimo" || prof == "ótimo" || prof == "otima" || prof == "ótima") { params.bucket_limit = 256; params.max_candidates = 1024; params.optimal_parse = true; params.matcher = LzssMatcher::BinaryTree; }
+    else return false;
+    return true;
+}
+
+// ApplyProfile plus "auto" (see lzss_auto.h), which leaves `params` alone.
+inline bool ApplyProfileOrAuto(const std::string& prof, LzssParams& params, bool& auto_profile) {
+    auto_profile = prof == "auto";
+    return auto_profile || ApplyProfile(prof, params);
+}
+
+// -m hash|arvore; returns false if the engine name is not recognised.
+inline bool ApplyMatcher(const std::string& name, LzssParams& params) {
+    if (name == "hash") params.matcher = LzssMatcher::HashChain;
+    else if (name == "arvore" || name == "árvore" || name == "tree") params.matcher = LzssMatcher::BinaryTree;
+    else return false;
+    return true;
+}
+
+// Cache options; ParseCacheOption returns false if `args[i]` is not one.
+struct CacheOptions {
+    bool enabled = false;
+    std::filesystem::path dir;
+    uint64_t max_bytes = LzssBlockCache::DEFAULT_MAX_BYTES;
+};
+
+inline bool ParseCacheOption(const Args& args, size_t& i, CacheOptions& opt) {
+    const std::string& a = args[i];
+    if (a == "--cache") opt.enabled = true;
+    else if (a == "--cache-dir" && i + 1 < args.size()) { opt.enabled = true; opt.dir = U8Path(args[++i]); }
+    else if (a == "--cache-mb" && i + 1 < args.size()) opt.max_bytes = std::strtoull(args[++i].c_str(), nullptr, 10) << 20;
+    else return false;
+    return true;
+}
+
+inline std::unique_ptr<LzssBlockCache> OpenCache(const CacheOptions& opt) {
+    if (!opt.enabled) return nullptr;
+    return std::make_unique<LzssBlockCache>(opt.dir.empty() ? DefaultLzssCacheDir() : opt.dir, opt.max_bytes);
+}
+
+inline void PrintCacheStats(const LzssBlockCache* cache, std::ostream& os = std::cout) {
+    if (!cache) return;
+    auto st = cache->stats();
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "Cache: %llu/%llu acertos (%.1f%%), %llu removidos, %.2f MB em disco\n",
+                  (unsigned long long)st.hits, (unsigned long long)(st.hits + st.misses), st.hit_rate() * 100.0,
+                  (unsigned long long)st.evicted, st.stored_bytes / 1048576.0);
+    os << buf;
+}
+
+// '*' and '?' wildcards over a single filename.
+inline bool GlobMatch(const char* pat, const char* s) {
+    const char* star = nullptr;
+    const char* retry = nullptr;
+    while (*s) {
+        if (*pat == '?' || *pat == *s) { ++pat; ++s; }
+        else if (*pat == '*') { star = pat++; retry = s; }
+        else if (star) { pat = star + 1; s = ++retry; }
+        else return false;
+    }
+    while (*pat == '*') ++pat;
+    return *pat == 0;
+}
+
+// ===== JSON output =====
+
+// Quoted JSON string from UTF-8 text.
+inline std::string JsonString(const std::string& s) {
+    std::string out = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') { out += '\\'; out += (char)c; }
+        else if (c == '\n') out += "\\n";
+        else if (c == '\r') out += "\\r";
+        else if (c == '\t') out += "\\t";
+        else if (c < 0x20) { char buf[8]; std::snprintf(buf, sizeof(buf), "\\u%04x", c); out += buf; }
+        else out += (char)c;
+    }
+    return out + "\"";
+}
+
+inline std::string JsonString(const std::filesystem::path& p) {
+    return JsonString(PathU8(p));
+}
+
+// LzssStats as the members of a JSON object (no braces), with a few derived averages.
+inline std::string StatsJsonFields(const LzssStats& st) {
+    auto array = [](const auto& a) {
+        std::string s = "[";
+        for (size_t k = 0; k < a.size(); ++k) s += (k ? ", " : "") + std::to_string(a[k]);
+        return s + "]";
+    };
+    uint64_t covered = 0;
+    for (size_t k = 0; k < st.match_length.size(); ++k) covered += st.match_length[k] * (k + 3);
+    char buf[640];
+    std::snprintf(buf, sizeof(buf),
+        "\"input_bytes\": %llu, \"output_bytes\": %llu, \"literals\": %llu, \"matches\": %llu, "
+        "\"avg_match_length\": %.2f, \"lazy_deferrals\": %llu, \"searches\": %llu, \"candidates\": %llu, "
+        "\"candidates_per_search\": %.2f, \"cutoffs\": %llu, \"seconds\": %.6f, ",
+        (unsigned long long)st.input_bytes, (unsigned long long)st.output_bytes,
+        (unsigned long long)st.literals, (unsigned long long)st.matches,
+        st.matches ? (double)covered / st.matches : 0.0,
+        (unsigned long long)st.lazy_deferrals, (unsigned long long)st.searches, (unsigned long long)st.candidates,
+        st.searches ? (double)st.candidates / st.searches : 0.0, (unsigned long long)st.cutoffs, st.seconds);
+    return buf + std::string("\"match_length_3_18\": ") + array(st.match_length)
+         + ", \"match_distance_log2\": " + array(st.match_distance);
+}
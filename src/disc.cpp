@@ -0,0 +1,398 @@
+#include "disc.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static inline uint32_t u32le(const uint8_t* b) {
+    return (uint32_t)(b[0] | (b[1] << 8) | (b[2] << 16) | (b[3] << 24));
+}
+
+// ===== SectorStream =====
+SectorStream::SectorStream(ByteView bytes, std::shared_ptr<const void> keep)
+    : base_(bytes.data()), stride_(std::max<size_t>(1, bytes.size())), user_offset_(0),
+      user_size_(stride_), size_(bytes.size()), keep_(std::move(keep)) {}
+
+SectorStream::SectorStream(const uint8_t* first_sector, size_t stride, size_t user_offset, size_t user_size,
+                           uint64_t length, std::shared_ptr<const void> keep)
+    : base_(first_sector), stride_(stride), user_offset_(user_offset), user_size_(user_size),
+      size_(length), keep_(std::move(keep)) {}
+
+ByteView SectorStream::contiguous() const {
+    if (stride_ != user_size_) return {};
+    return { base_ + user_offset_, (size_t)size_ };
+}
+
+ByteView SectorStream::chunk(uint64_t pos, uint64_t max) const {
+    if (pos >= size_) return {};
+    max = std::min(max, size_ - pos);
+    if (stride_ == user_size_) return { base_ + user_offset_ + pos, (size_t)max };
+    uint64_t sec = pos / user_size_, within = pos % user_size_;
+    return { base_ + sec * stride_ + user_offset_ + within, (size_t)std::min<uint64_t>(max, user_size_ - within) };
+}
+
+void SectorStream::check(uint64_t pos, uint64_t n) const {
+    if (pos > size_ || n > size_ - pos) throw std::runtime_error("Leitura além do fim do arquivo.");
+}
+
+void SectorStream::read(uint64_t pos, uint8_t* dst, size_t n) const {
+    for_each_chunk(pos, n, [&](const uint8_t* p, size_t len) {
+        std::memcpy(dst, p, len);
+        dst += len;
+    });
+}
+
+std::vector<uint8_t> SectorStream::read(uint64_t pos, size_t n) const {
+    check(pos, n);
+    std::vector<uint8_t> out(n);
+    read(pos, out.data(), n);
+    return out;
+}
+
+void WriteStreamRange(const std::filesystem::path& target, const SectorStream& s, uint64_t pos, uint64_t n) {
+    AtomicFileWriter w(target, n);
+    s.for_each_chunk(pos, n, [&](const uint8_t* p, size_t len) { w.write(p, len); });
+    w.commit();
+}
+
+// ===== DiscImage =====
+static std::string Upper(std::string s) {
+    for (auto& c : s) c = (char)std::toupper((unsigned char)c);
+    return s;
+}
+
+// "/DATA\\X.PUD;1" -> "DATA/X.PUD"
+static std::string NormalizeDiscPath(std::string p) {
+    std::replace(p.begin(), p.end(), '\\', '/');
+    size_t a = p.find_first_not_of('/');
+    p.erase(0, a == std::string::npos ? p.size() : a);
+    size_t semi = p.rfind(';');
+    if (semi != std::string::npos && p.find('/', semi) == std::string::npos) p.erase(semi);
+    while (!p.empty() && p.back() == '/') p.pop_back();
+    return p;
+}
+
+namespace {
+    struct CueTrack {
+        std::filesystem::path bin;
+        size_t sector_size = 0;
+        size_t user_offset = 0;
+        int mode = 0;
+    };
+}
+
+// First FILE and its first TRACK; the data track of a PS1 disc.
+static CueTrack ParseCue(const std::filesystem::path& cue) {
+    std::ifstream f(cue);
+    if (!f) throw std::runtime_error("Falha ao abrir arquivo: " + cue.string());
+    CueTrack t;
+    std::string line;
+    while (std::getline(f, line)) {
+        std::string u = Upper(line);
+        size_t k = u.find_first_not_of(" \t");
+        if (k == std::string::npos) continue;
+        if (u.compare(k, 5, "FILE ") == 0 && t.bin.empty()) {
+            size_t q1 = line.find('"', k), q2 = q1 == std::string::npos ? q1 : line.find('"', q1 + 1);
+            std::string name;
+            if (q2 != std::string::npos) name = line.substr(q1 + 1, q2 - q1 - 1);
+            else {
+                size_t a = line.find_first_not_of(" \t", k + 5), b = line.find_first_of(" \t", a);
+                if (a != std::string::npos) name = line.substr(a, b == std::string::npos ? b : b - a);
+            }
+            t.bin = cue.parent_path() / std::filesystem::u8path(name);
+        } else if (u.compare(k, 6, "TRACK ") == 0 && !t.bin.empty()) {
+            if (u.find("MODE2/2352") != std::string::npos)      { t.sector_size = 2352; t.user_offset = 24; t.mode = 2; }
+            else if (u.find("MODE1/2352") != std::string::npos) { t.sector_size = 2352; t.user_offset = 16; t.mode = 1; }
+            else if (u.find("MODE2/2336") != std::string::npos) { t.sector_size = 2336; t.user_offset = 8;  t.mode = 2; }
+            else if (u.find("MODE1/2048") != std::string::npos) { t.sector_size = 2048; t.user_offset = 0;  t.mode = 1; }
+            else throw std::runtime_error("Primeira trilha do CUE não é de dados: " + line);
+            return t;
+        }
+    }
+    throw std::runtime_error("CUE sem FILE/TRACK de dados: " + cue.string());
+}
+
+DiscImage::DiscImage(const std::filesystem::path& image) {
+    std::string ext = Upper(image.extension().string());
+    CueTrack cue;
+    if (ext == ".CUE") cue = ParseCue(image);
+    bin_ = ext == ".CUE" ? cue.bin : image;
+    map_ = MapFile(bin_);
+    const uint8_t* d = map_->data();
+    const size_t n = map_->size();
+
+    if (cue.sector_size) {
+        sector_size_ = cue.sector_size; user_offset_ = cue.user_offset; mode_ = cue.mode;
+    } else {
+        // Raw sectors start with the 12-byte sync pattern; the mode byte follows the address.
+        static const uint8_t sync[12] = { 0, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0 };
+        const size_t raw16 = 16 * CD_SECTOR_RAW;
+        if (n >= raw16 + CD_SECTOR_RAW && std::memcmp(d + raw16, sync, 12) == 0) {
+            sector_size_ = CD_SECTOR_RAW;
+            mode_ = d[raw16 + 15];
+            user_offset_ = mode_ == 1 ? 16 : 24;
+        } else if (n >= 17 * CD_SECTOR_DATA && std::memcmp(d + 16 * CD_SECTOR_DATA + 1, "CD001", 5) == 0) {
+            sector_size_ = CD_SECTOR_DATA; user_offset_ = 0; mode_ = 1;
+        } else {
+            throw std::runtime_error("Imagem de disco não reconhecida (esperado BIN 2352 ou ISO 2048): " + bin_.string());
+        }
+    }
+    sectors_ = (uint32_t)(n / sector_size_);
+    read_tree();
+}
+
+const uint8_t* DiscImage::sector(uint32_t lba) const {
+    if (lba >= sectors_) throw std::runtime_error("Setor " + std::to_string(lba) + " fora da imagem.");
+    return map_->data() + (size_t)lba * sector_size_;
+}
+
+SectorStream DiscImage::open(const DiscEntry& e) const {
+    uint64_t count = (e.size + CD_SECTOR_DATA - 1) / CD_SECTOR_DATA;
+    if ((uint64_t)e.lba + count > sectors_)
+        throw std::runtime_error("Arquivo além do fim da imagem: " + e.path);
+    if (e.size == 0) return SectorStream();
+    return SectorStream(sector(e.lba), sector_size_, user_offset_, CD_SECTOR_DATA, e.size, map_);
+}
+
+const DiscEntry* DiscImage::find(const std::string& path) const {
+    std::string want = Upper(NormalizeDiscPath(path));
+    for (auto& e : entries_)
+        if (Upper(e.path) == want) return &e;
+    return nullptr;
+}
+
+void DiscImage::read_tree() {
+    const uint8_t* pvd = sector(16) + user_offset_;
+    if (pvd[0] != 1 || std::memcmp(pvd + 1, "CD001", 5) != 0)
+        throw std::runtime_error("Descritor de volume ISO9660 não encontrado no setor 16.");
+
+    struct Dir { std::string path; uint32_t lba, size; int depth; };
+    std::vector<Dir> stack{ { "", u32le(pvd + 156 + 2), u32le(pvd + 156 + 10), 0 } };
+    std::vector<uint32_t> seen;
+    while (!stack.empty()) {
+        Dir dir = stack.back();
+        stack.pop_back();
+        // Cyclic or absurdly deep trees come only from damaged images.
+        if (dir.depth > 32 || std::find(seen.begin(), seen.end(), dir.lba) != seen.end()) continue;
+        seen.push_back(dir.lba);
+        SectorStream s = open(DiscEntry{ dir.path, dir.lba, dir.size, true });
+        std::vector<Dir> subdirs;
+        // Records never cross a sector; a zero length byte ends the sector's records.
+        for (uint64_t sec = 0; sec * CD_SECTOR_DATA < s.size(); ++sec) {
+            ByteView blk = s.chunk(sec * CD_SECTOR_DATA, CD_SECTOR_DATA);
+            size_t pos = 0;
+            while (pos + 34 <= blk.size()) {
+                const uint8_t* r = blk.data() + pos;
+                size_t len = r[0], name_len = r[32];
+                if (len == 0) break;
+                if (len < 34 || pos + len > blk.size() || 33 + name_len > len) break;
+                const uint32_t record_offset = (uint32_t)pos;
+                pos += len;
+                if (name_len == 1 && (r[33] == 0 || r[33] == 1)) continue;   // "." and ".."
+                std::string name((const char*)r + 33, name_len);
+                size_t semi = name.find(';');
+                if (semi != std::string::npos) name.erase(semi);
+                if (!name.empty() && name.back() == '.') name.pop_back();
+                DiscEntry e{ dir.path.empty() ? name : dir.path + "/" + name, u32le(r + 2), u32le(r + 10), (r[25] & 2) != 0,
+                             dir.lba + (uint32_t)sec, record_offset };
+                entries_.push_back(e);
+                if (e.is_dir) subdirs.push_back({ e.path, e.lba, e.size, dir.depth + 1 });
+            }
+        }
+        // Pushed in reverse so that the walk visits them in directory order.
+        stack.insert(stack.end(), subdirs.rbegin(), subdirs.rend());
+    }
+}
+
+// ===== EDC/ECC =====
+namespace {
+    // EDC is a reflected CRC-32 (polynomial 0x8001801B); ECC is the P/Q
+    // Reed-Solomon product code over GF(2^8), both from ECMA-130.
+    struct EccTables {
+        uint32_t edc[256];
+        uint8_t f[256];
+        uint8_t b[256];
+        EccTables() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t j = (i << 1) ^ (i & 0x80 ? 0x11D : 0);
+                f[i] = (uint8_t)j;
+                b[i ^ j] = (uint8_t)i;
+                uint32_t e = i;
+                for (int k = 0; k < 8; ++k) e = (e >> 1) ^ (e & 1 ? 0xD8018001 : 0);
+                edc[i] = e;
+            }
+        }
+    };
+    const EccTables& Tables() {
+        static const EccTables t;
+        return t;
+    }
+}
+
+static uint32_t ComputeEdc(const uint8_t* p, size_t n) {
+    const auto& t = Tables();
+    uint32_t edc = 0;
+    while (n--) edc = (edc >> 8) ^ t.edc[(edc ^ *p++) & 0xFF];
+    return edc;
+}
+
+// One parity block (P: 86 x 24, Q: 52 x 43) over the 2340 bytes from the header.
+static void ComputeEccBlock(const uint8_t* src, uint32_t major_count, uint32_t minor_count, uint32_t major_mult,
+                            uint32_t minor_inc, uint8_t* dest) {
+    const auto& t = Tables();
+    const uint32_t size = major_count * minor_count;
+    for (uint32_t major = 0; major < major_count; ++major) {
+        uint32_t index = (major >> 1) * major_mult + (major & 1);
+        uint8_t a = 0, b = 0;
+        for (uint32_t minor = 0; minor < minor_count; ++minor) {
+            uint8_t v = src[index];
+            index += minor_inc;
+            if (index >= size) index -= size;
+            a ^= v;
+            b ^= v;
+            a = t.f[a];
+        }
+        a = t.b[t.f[a] ^ b];
+        dest[major] = a;
+        dest[major + major_count] = a ^ b;
+    }
+}
+
+// Recomputes EDC and ECC of a raw 2352-byte Mode 1 or Mode 2 Form 1 sector.
+// Mode 2 ECC is computed with the header zeroed, as the standard requires.
+static void RegenerateSector(uint8_t* s) {
+    if (s[15] == 1) {
+        uint32_t edc = ComputeEdc(s, 0x810);
+        for (int k = 0; k < 4; ++k) s[0x810 + k] = (uint8_t)(edc >> (8 * k));
+        std::memset(s + 0x814, 0, 8);
+        ComputeEccBlock(s + 0xC, 86, 24, 2, 86, s + 0x81C);
+        ComputeEccBlock(s + 0xC, 52, 43, 86, 88, s + 0x8C8);
+        return;
+    }
+    uint32_t edc = ComputeEdc(s + 0x10, 0x808);
+    for (int k = 0; k < 4; ++k) s[0x818 + k] = (uint8_t)(edc >> (8 * k));
+    uint8_t header[4];
+    std::memcpy(header, s + 12, 4);
+    std::memset(s + 12, 0, 4);
+    ComputeEccBlock(s + 0xC, 86, 24, 2, 86, s + 0x81C);
+    ComputeEccBlock(s + 0xC, 52, 43, 86, 88, s + 0x8C8);
+    std::memcpy(s + 12, header, 4);
+}
+
+// EDC/ECC for a sector of `sector_size` bytes (2352, 2336 or 2048) in place.
+static void RegenerateImageSector(uint8_t* s, size_t sector_size) {
+    if (sector_size == CD_SECTOR_RAW) { RegenerateSector(s); return; }
+    if (sector_size == CD_SECTOR_DATA) return;   // plain ISO: no EDC/ECC stored
+    // MODE2/2336 has no sync or header; they are zero for the ECC anyway.
+    uint8_t full[CD_SECTOR_RAW] = {};
+    full[15] = 2;
+    std::memcpy(full + 16, s, sector_size);
+    RegenerateSector(full);
+    std::memcpy(s, full + 16, sector_size);
+}
+
+// ===== In-place patching =====
+// Mode 2 subheader submode bits.
+constexpr uint8_t SUBMODE_EOR   = 0x01;
+constexpr uint8_t SUBMODE_FORM2 = 0x20;
+constexpr uint8_t SUBMODE_EOF   = 0x80;
+
+DiscPatchResult PatchDiscFile(const std::filesystem::path& image, const std::string& path, ByteView data,
+                              unsigned threads) {
+    DiscPatchResult res;
+    std::filesystem::path bin;
+    size_t sector_size = 0;
+    uint32_t lba = 0;
+    // Rebuilt sectors, and which of them differ from the image.
+    std::vector<uint8_t> sectors;
+    std::vector<char> changed;
+    std::vector<uint8_t> record_sector;
+    uint32_t record_lba = 0;
+    {
+        DiscImage disc(image);
+        const DiscEntry* e = disc.find(path);
+        if (!e || e->is_dir) throw std::runtime_error("Arquivo não encontrado na imagem: " + path);
+        bin = disc.bin_path();
+        sector_size = disc.sector_size();
+        lba = e->lba;
+        const size_t user_offset = disc.user_offset();
+        const uint32_t count = (uint32_t)((e->size + CD_SECTOR_DATA - 1) / CD_SECTOR_DATA);
+        const uint64_t capacity = (uint64_t)count * CD_SECTOR_DATA;
+        if (data.size() > capacity)
+            throw std::runtime_error("Novo " + e->path + " não cabe no lugar do original: " + std::to_string(data.size())
+                                     + " bytes, a extensão tem " + std::to_string(capacity) + " (" + std::to_string(count)
+                                     + " setores a partir do " + std::to_string(lba) + ").");
+        if ((uint64_t)lba + count > disc.sector_count())
+            throw std::runtime_error("Arquivo além do fim da imagem: " + e->path);
+        res.sectors = count;
+        res.old_size = e->size;
+        res.new_size = (uint32_t)data.size();
+
+        // Mode 2 marks the file's last sector with EOR/EOF in the submode. When the
+        // file now ends in an earlier sector, the marks move there, in both copies
+        // of the subheader; an original without them is left without them.
+        const bool mode2 = disc.mode() == 2 && sector_size != CD_SECTOR_DATA;
+        const size_t submode = user_offset - 8 + 2;
+        const uint32_t old_last = count - 1;
+        const uint32_t new_last = data.size() ? (uint32_t)((data.size() - 1) / CD_SECTOR_DATA) : 0;
+        const uint8_t end_marks = mode2 && count ? disc.sector(lba + old_last)[submode] & (SUBMODE_EOR | SUBMODE_EOF) : 0;
+
+        sectors.resize((size_t)count * sector_size);
+        changed.assign(count, 0);
+        ParallelFor(count, threads, [&](size_t i) {
+            const uint8_t* old = disc.sector(lba + (uint32_t)i);
+            uint8_t* s = sectors.data() + i * sector_size;
+            std::memcpy(s, old, sector_size);
+            // Form 2 (bit 5 of the submode) has no ECC and 2324 bytes of user data.
+            if (mode2 && (s[submode] & SUBMODE_FORM2))
+                throw std::runtime_error("Setor " + std::to_string(lba + i) + " de " + e->path
+                                         + " é Mode 2 Form 2; não é possível gravar no lugar.");
+            const uint64_t pos = (uint64_t)i * CD_SECTOR_DATA;
+            const size_t n = (size_t)std::min<uint64_t>(CD_SECTOR_DATA, data.size() > pos ? data.size() - pos : 0);
+            uint8_t* user = s + user_offset;
+            std::memcpy(user, data.data() + pos, n);
+            std::memset(user + n, 0, CD_SECTOR_DATA - n);
+            if (end_marks && old_last != new_last && (i == old_last || i == new_last)) {
+                const uint8_t marks = i == new_last ? end_marks : 0;
+                s[submode] = (uint8_t)((s[submode] & ~end_marks) | marks);
+                s[submode + 4] = (uint8_t)((s[submode + 4] & ~end_marks) | marks);
+            }
+            // User data and, in Mode 2, the subheader before it.
+            const size_t from = mode2 ? user_offset - 8 : user_offset;
+            if (std::memcmp(s + from, old + from, user_offset + CD_SECTOR_DATA - from) == 0) return;
+            RegenerateImageSector(s, sector_size);
+            changed[i] = 1;
+        });
+
+        if (res.new_size != res.old_size && e->record_lba != 0) {
+            record_lba = e->record_lba;
+            record_sector.assign(disc.sector(record_lba), disc.sector(record_lba) + sector_size);
+            uint8_t* r = record_sector.data() + user_offset + e->record_offset;
+            for (int k = 0; k < 4; ++k) {
+                r[10 + k] = (uint8_t)(res.new_size >> (8 * k));
+                r[17 - k] = (uint8_t)(res.new_size >> (8 * k));
+            }
+            RegenerateImageSector(record_sector.data(), sector_size);
+        }
+    }   // the image is unmapped here, before it is opened for writing
+
+    // Consecutive changed sectors go out in one write.
+    FilePatchWriter w(bin);
+    for (uint32_t i = 0; i < res.sectors;) {
+        if (!changed[i]) { ++i; continue; }
+        uint32_t j = i;
+        while (j < res.sectors && changed[j]) ++j;
+        w.write_at((uint64_t)(lba + i) * sector_size, sectors.data() + (size_t)i * sector_size,
+                   (size_t)(j - i) * sector_size);
+        res.changed += j - i;
+        i = j;
+    }
+    if (!record_sector.empty()) {
+        w.write_at((uint64_t)record_lba * sector_size, record_sector.data(), sector_size);
+        ++res.changed;
+    }
+    w.flush();
+    return res;
+}
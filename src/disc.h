@@ -0,0 +1,120 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include "fileio.h"
+
+// PS1 disc images (BIN/CUE with raw 2352-byte sectors, or plain 2048-byte
+// ISO) read through a memory mapping, with the ISO9660 directory tree.
+// Files are exposed as SectorStreams over the mapping: nothing is copied
+// until a caller reads, and then only the bytes it asks for.
+
+constexpr size_t CD_SECTOR_RAW = 2352;
+constexpr size_t CD_SECTOR_DATA = 2048;   // Mode 1 / Mode 2 Form 1 user data
+
+// A file's user data laid out over fixed-size sectors: `user_size` bytes at
+// `user_offset` of every `stride`-byte sector. A plain contiguous range is
+// the special case stride == user_size. Reads past size() throw.
+class SectorStream {
+public:
+    SectorStream() = default;
+    // Contiguous bytes (e.g. a file mapped from disk); `keep` owns them.
+    explicit SectorStream(ByteView bytes, std::shared_ptr<const void> keep = nullptr);
+    SectorStream(const uint8_t* first_sector, size_t stride, size_t user_offset, size_t user_size,
+                 uint64_t length, std::shared_ptr<const void> keep);
+
+    uint64_t size() const { return size_; }
+    // The whole stream when its bytes are contiguous in memory, otherwise empty.
+    ByteView contiguous() const;
+    // Bytes from `pos` up to the end of its sector, at most `max`.
+    ByteView chunk(uint64_t pos, uint64_t max) const;
+    void read(uint64_t pos, uint8_t* dst, size_t n) const;
+    std::vector<uint8_t> read(uint64_t pos, size_t n) const;
+    std::vector<uint8_t> read_all() const { return read(0, (size_t)size_); }
+    // fn(const uint8_t*, size_t) for each in-memory piece of [pos, pos + n).
+    template <class Fn>
+    void for_each_chunk(uint64_t pos, uint64_t n, Fn&& fn) const {
+        check(pos, n);
+        while (n > 0) {
+            ByteView c = chunk(pos, n);
+            fn(c.data(), c.size());
+            pos += c.size();
+            n -= c.size();
+        }
+    }
+    const std::shared_ptr<const void>& storage() const { return keep_; }
+
+private:
+    void check(uint64_t pos, uint64_t n) const;
+
+    const uint8_t* base_ = nullptr;
+    size_t stride_ = 1;
+    size_t user_offset_ = 0;
+    size_t user_size_ = 1;
+    uint64_t size_ = 0;
+    std::shared_ptr<const void> keep_;
+};
+
+// Writes [pos, pos + n) of `s` to `target` (AtomicFileWriter), piece by piece.
+void WriteStreamRange(const std::filesystem::path& target, const SectorStream& s, uint64_t pos, uint64_t n);
+
+struct DiscEntry {
+    std::string path;     // '/'-separated from the root, without ";1"
+    uint32_t lba = 0;     // first sector
+    uint32_t size = 0;    // bytes
+    bool is_dir = false;
+    uint32_t record_lba = 0;      // sector of its directory record (0 for none)
+    uint32_t record_offset = 0;   // byte offset of the record in that sector's user data
+};
+
+class DiscImage {
+public:
+    // A .cue (its first track's BIN is opened) or the BIN/ISO itself. The
+    // sector layout is taken from the cue, or detected from sector 16.
+    explicit DiscImage(const std::filesystem::path& image);
+
+    const std::filesystem::path& bin_path() const { return bin_; }
+    size_t sector_size() const { return sector_size_; }       // 2352 or 2048
+    size_t user_offset() const { return user_offset_; }       // 24 (Mode 2), 16 (Mode 1) or 0
+    int mode() const { return mode_; }                        // 1 or 2
+    uint32_t sector_count() const { return sectors_; }
+    // Every file and directory, directories before their contents.
+    const std::vector<DiscEntry>& entries() const { return entries_; }
+    // Case-insensitive lookup; a leading '/' or '\\' is optional and ";1" ignored.
+    const DiscEntry* find(const std::string& path) const;
+    // The entry's user data; throws if its extent runs past the image.
+    SectorStream open(const DiscEntry& e) const;
+    // Raw sector `lba` (sector_size() bytes).
+    const uint8_t* sector(uint32_t lba) const;
+
+private:
+    void read_tree();
+
+    std::filesystem::path bin_;
+    std::shared_ptr<const MappedFile> map_;
+    size_t sector_size_ = CD_SECTOR_RAW;
+    size_t user_offset_ = 24;
+    int mode_ = 2;
+    uint32_t sectors_ = 0;
+    std::vector<DiscEntry> entries_;
+};
+
+struct DiscPatchResult {
+    uint32_t sectors = 0;      // sectors in the file's extent
+    uint32_t changed = 0;      // sectors actually rewritten (directory record included)
+    uint32_t old_size = 0;
+    uint32_t new_size = 0;
+};
+
+// Overwrites file `path` of `image` in place with `data`, which must fit the
+// sectors the file already owns (its size rounded up to 2048). Only sectors
+// whose user data changes are written, with their EDC/ECC recomputed on
+// `threads` workers; the tail of the last sector is zeroed and the directory
+// record is updated when the size changes. In Mode 2 the EOR/EOF submode marks
+// follow the file's new last sector. Throws, without writing, if the data does
+// not fit or the extent holds Mode 2 Form 2 sectors.
+DiscPatchResult PatchDiscFile(const std::filesystem::path& image, const std::string& path, ByteView data,
+                              unsigned threads = 0);
@@ -0,0 +1,255 @@
+#include "fileio.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static std::runtime_error IoError(const char* what, const std::filesystem::path& p) {
+    return std::runtime_error(std::string(what) + p.string());
+}
+
+// "<target>.<pid>.<n>.tmp": each writer, in this process or another, gets its
+// own temporary, so concurrent writers of one target never share a file and
+// the last rename wins.
+static std::filesystem::path TempPathFor(const std::filesystem::path& target, unsigned long pid) {
+    static std::atomic<unsigned> counter{ 0 };
+    std::filesystem::path p = target;
+    p += "." + std::to_string(pid) + "." + std::to_string(counter++) + ".tmp";
+    return p;
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& p) {
+    HANDLE f = CreateFileW(p.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (f == INVALID_HANDLE_VALUE) throw IoError("Falha ao abrir arquivo: ", p);
+    LARGE_INTEGER sz{};
+    if (!GetFileSizeEx(f, &sz)) { CloseHandle(f); throw IoError("Falha ao abrir arquivo: ", p); }
+    file_ = f;
+    size_ = (size_t)sz.QuadPart;
+    if (size_ == 0) return;
+    HANDLE m = CreateFileMappingW(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) { CloseHandle(f); throw IoError("Falha ao mapear arquivo: ", p); }
+    void* v = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (!v) { CloseHandle(m); CloseHandle(f); throw IoError("Falha ao mapear arquivo: ", p); }
+    mapping_ = m;
+    data_ = (const uint8_t*)v;
+}
+
+MappedFile::~MappedFile() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle((HANDLE)mapping_);
+    if (file_) CloseHandle((HANDLE)file_);
+}
+
+AtomicFileWriter::AtomicFileWriter(const std::filesystem::path& target, uint64_t expected_size, bool durable)
+    : target_(target), temp_(TempPathFor(target, GetCurrentProcessId())), durable_(durable) {
+    // A temporary left behind by a crashed run under a recycled pid just moves
+    // this writer on to the next number.
+    HANDLE h = INVALID_HANDLE_VALUE;
+    for (int tries = 0; tries < 100; ++tries) {
+        h = CreateFileW(temp_.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (h != INVALID_HANDLE_VALUE || GetLastError() != ERROR_FILE_EXISTS) break;
+        temp_ = TempPathFor(target, GetCurrentProcessId());
+    }
+    if (h == INVALID_HANDLE_VALUE) throw IoError("Falha ao salvar: ", target_);
+    handle_ = h;
+    if (expected_size > 0) {
+        FILE_ALLOCATION_INFO info{};
+        info.AllocationSize.QuadPart = (LONGLONG)expected_size;
+        SetFileInformationByHandle(h, FileAllocationInfo, &info, sizeof(info));
+    }
+}
+
+void AtomicFileWriter::write(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        DWORD chunk = (DWORD)std::min<size_t>(size, 1u << 30);
+        DWORD done = 0;
+        if (!WriteFile((HANDLE)handle_, data, chunk, &done, nullptr) || done == 0)
+            throw IoError("Falha ao salvar: ", target_);
+        data += done; size -= done; written_ += done;
+    }
+}
+
+void AtomicFileWriter::close_handle() {
+    if (handle_) { CloseHandle((HANDLE)handle_); handle_ = nullptr; }
+}
+
+void AtomicFileWriter::commit() {
+    // A durable file's data must be on disk before the rename makes it the target.
+    if (durable_ && !FlushFileBuffers((HANDLE)handle_)) throw IoError("Falha ao salvar: ", target_);
+    close_handle();
+    if (!MoveFileExW(temp_.c_str(), target_.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | (durable_ ? MOVEFILE_WRITE_THROUGH : 0)))
+        throw IoError("Falha ao salvar: ", target_);
+    committed_ = true;
+}
+
+FilePatchWriter::FilePatchWriter(const std::filesystem::path& target) : target_(target) {
+    HANDLE h = CreateFileW(target_.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) throw IoError("Falha ao abrir para gravação: ", target_);
+    handle_ = h;
+}
+
+FilePatchWriter::~FilePatchWriter() {
+    if (handle_) CloseHandle((HANDLE)handle_);
+}
+
+void FilePatchWriter::flush() {
+    if (!FlushFileBuffers((HANDLE)handle_)) throw IoError("Falha ao salvar: ", target_);
+}
+
+void FilePatchWriter::write_at(uint64_t offset, const uint8_t* data, size_t size) {
+    LARGE_INTEGER pos{};
+    pos.QuadPart = (LONGLONG)offset;
+    if (!SetFilePointerEx((HANDLE)handle_, pos, nullptr, FILE_BEGIN)) throw IoError("Falha ao salvar: ", target_);
+    while (size > 0) {
+        DWORD chunk = (DWORD)std::min<size_t>(size, 1u << 30);
+        DWORD done = 0;
+        if (!WriteFile((HANDLE)handle_, data, chunk, &done, nullptr) || done == 0)
+            throw IoError("Falha ao salvar: ", target_);
+        data += done; size -= done;
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& p) {
+    int fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw IoError("Falha ao abrir arquivo: ", p);
+    struct stat st{};
+    if (fstat(fd, &st) != 0) { ::close(fd); throw IoError("Falha ao abrir arquivo: ", p); }
+    size_ = (size_t)st.st_size;
+    if (size_ > 0) {
+        void* v = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (v == MAP_FAILED) { ::close(fd); throw IoError("Falha ao mapear arquivo: ", p); }
+        madvise(v, size_, MADV_SEQUENTIAL);
+        data_ = (const uint8_t*)v;
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_) munmap((void*)data_, size_);
+}
+
+AtomicFileWriter::AtomicFileWriter(const std::filesystem::path& target, uint64_t expected_size, bool durable)
+    : target_(target), temp_(TempPathFor(target, (unsigned long)getpid())), durable_(durable) {
+    // A temporary left behind by a crashed run under a recycled pid just moves
+    // this writer on to the next number.
+    for (int tries = 0; tries < 100; ++tries) {
+        fd_ = ::open(temp_.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd_ >= 0 || errno != EEXIST) break;
+        temp_ = TempPathFor(target, (unsigned long)getpid());
+    }
+    if (fd_ < 0) throw IoError("Falha ao salvar: ", target_);
+    if (expected_size > 0) {
+#ifdef __linux__
+        posix_fallocate(fd_, 0, (off_t)expected_size);
+#endif
+    }
+}
+
+void AtomicFileWriter::write(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t done = ::write(fd_, data, size);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) throw IoError("Falha ao salvar: ", target_);
+        data += done; size -= (size_t)done; written_ += (uint64_t)done;
+    }
+}
+
+void AtomicFileWriter::close_handle() {
+    if (fd_ >= 0) { ::close(fd_); fd_ = -1; }
+}
+
+void AtomicFileWriter::commit() {
+    // Drop any preallocated space beyond what was actually written.
+    if (ftruncate(fd_, (off_t)written_) != 0) throw IoError("Falha ao salvar: ", target_);
+    // A durable file's data must be on disk before the rename makes it the
+    // target, and the rename itself only sticks once the directory is synced too.
+    if (durable_ && fsync(fd_) != 0) throw IoError("Falha ao salvar: ", target_);
+    close_handle();
+    if (::rename(temp_.c_str(), target_.c_str()) != 0) throw IoError("Falha ao salvar: ", target_);
+    committed_ = true;
+    if (!durable_) return;
+    std::filesystem::path dir = target_.parent_path();
+    int dfd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd >= 0) {
+        fsync(dfd);
+        ::close(dfd);
+    }
+}
+
+FilePatchWriter::FilePatchWriter(const std::filesystem::path& target) : target_(target) {
+    fd_ = ::open(target_.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd_ < 0) throw IoError("Falha ao abrir para gravação: ", target_);
+}
+
+FilePatchWriter::~FilePatchWriter() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+void FilePatchWriter::flush() {
+    if (fsync(fd_) != 0) throw IoError("Falha ao salvar: ", target_);
+}
+
+void FilePatchWriter::write_at(uint64_t offset, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t done = ::pwrite(fd_, data, size, (off_t)offset);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) throw IoError("Falha ao salvar: ", target_);
+        data += done; size -= (size_t)done; offset += (uint64_t)done;
+    }
+}
+
+#endif
+
+AtomicFileWriter::~AtomicFileWriter() {
+    if (committed_) return;
+    close_handle();
+    std::error_code ec;
+    std::filesystem::remove(temp_, ec);
+}
+
+void AtomicFileWriter::write_zeros(size_t count) {
+    static const uint8_t zeros[4096] = {};
+    while (count > 0) {
+        size_t chunk = std::min(count, sizeof(zeros));
+        write(zeros, chunk);
+        count -= chunk;
+    }
+}
+
+std::shared_ptr<const MappedFile> MapFile(const std::filesystem::path& p) {
+    return std::make_shared<const MappedFile>(p);
+}
+
+std::vector<uint8_t> ReadAllBytes(const std::filesystem::path& p) {
+    MappedFile m(p);
+    return std::vector<uint8_t>(m.data(), m.data() + m.size());
+}
+
+void WriteAllBytes(const std::filesystem::path& p, const uint8_t* data, size_t size, bool durable) {
+    AtomicFileWriter w(p, size, durable);
+    w.write(data, size);
+    w.commit();
+}
+
+void WriteAllBytes(const std::filesystem::path& p, const std::vector<uint8_t>& bytes, bool durable) {
+    WriteAllBytes(p, bytes.data(), bytes.size(), durable);
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+// Shared file I/O for the GUI and the CLIs.
+// Reads go through a read-only memory mapping; writes go to a temporary
+// "<target>.<pid>.<n>.tmp" of their own, preallocated to the final size, and are renamed over the target only once
+// complete, so an interrupted run never leaves a truncated file behind.
+// Durable writes also flush the data to disk before the rename, so that a
+// crash or power loss cannot leave a torn file either; this costs about a
+// third of the write speed and is meant for files whose loss is not cheap to
+// redo (repacked archives, patched images), not for extraction or caches.
+
+// Non-owning byte range (C++17 stand-in for std::span<const uint8_t>).
+struct ByteView {
+    const uint8_t* ptr = nullptr;
+    size_t len = 0;
+
+    const uint8_t* data() const { return ptr; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    const uint8_t* begin() const { return ptr; }
+    const uint8_t* end() const { return ptr + len; }
+    std::vector<uint8_t> to_vector() const { return std::vector<uint8_t>(begin(), end()); }
+};
+
+// Read-only mapping of a whole file. Empty files map to an empty range.
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path& p);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+std::shared_ptr<const MappedFile> MapFile(const std::filesystem::path& p);
+
+// Output file written through a temporary and moved into place by commit().
+// If the object is destroyed before commit(), the temporary is deleted and
+// the target is left untouched.
+class AtomicFileWriter {
+public:
+    // expected_size > 0 preallocates the temporary. durable = flush the data
+    // (and on POSIX the directory entry) to disk in commit().
+    explicit AtomicFileWriter(const std::filesystem::path& target, uint64_t expected_size = 0,
+                              bool durable = false);
+    ~AtomicFileWriter();
+    AtomicFileWriter(const AtomicFileWriter&) = delete;
+    AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+
+    void write(const uint8_t* data, size_t size);
+    void write_zeros(size_t count);
+    uint64_t written() const { return written_; }
+    void commit();
+
+private:
+    void close_handle();
+
+    std::filesystem::path target_;
+    std::filesystem::path temp_;
+    uint64_t written_ = 0;
+    bool durable_ = false;
+    bool committed_ = false;
+#ifdef _WIN32
+    void* handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+// Writes into an existing file at given offsets, leaving the rest of it
+// untouched. There is no temporary: this is for patching a few sectors of a
+// disc image, where rewriting the whole file is exactly what is avoided.
+class FilePatchWriter {
+public:
+    explicit FilePatchWriter(const std::filesystem::path& target);
+    ~FilePatchWriter();
+    FilePatchWriter(const FilePatchWriter&) = delete;
+    FilePatchWriter& operator=(const FilePatchWriter&) = delete;
+
+    void write_at(uint64_t offset, const uint8_t* data, size_t size);
+    // Waits until everything written is on disk.
+    void flush();
+
+private:
+    std::filesystem::path target_;
+#ifdef _WIN32
+    void* handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+std::vector<uint8_t> ReadAllBytes(const std::filesystem::path& p);
+void WriteAllBytes(const std::filesystem::path& p, const uint8_t* data, size_t size, bool durable = false);
+void WriteAllBytes(const std::filesystem::path& p, const std::vector<uint8_t>& bytes, bool durable = false);
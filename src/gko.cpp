@@ -1,11 +1,13 @@
 #include "gko.h"
+#include "fileio.h"
+#include "parallel.h"
 #include <stdexcept>
 #include <algorithm>
-#include <fstream>
 #include <array>
-#include <windows.h>
 #include <unordered_map>
-#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
 
 static inline uint16_t u16le(const uint8_t* b) {
     return (uint16_t)(b[0] | (b[1] << 8));
@@ -13,35 +15,78 @@ static inline uint16_t u16le(const uint8_t* b) {
 static inline uint32_t u32le(const uint8_t* b) {
     return (uint32_t)(b[0] | (b[1] << 8) | (b[2] << 16) | (b[3] << 24));
 }
-static inline void p32(std::vector<uint8_t>& out, uint32_t v) {
-    out.push_back((uint8_t)(v & 0xFF));
-    out.push_back((uint8_t)((v >> 8) & 0xFF));
-    out.push_back((uint8_t)((v >> 16) & 0xFF));
-    out.push_back((uint8_t)((v >> 24) & 0xFF));
+static inline void w32le(uint8_t* b, uint32_t v) {
+    b[0] = (uint8_t)(v & 0xFF);
+    b[1] = (uint8_t)((v >> 8) & 0xFF);
+    b[2] = (uint8_t)((v >> 16) & 0xFF);
+    b[3] = (uint8_t)((v >> 24) & 0xFF);
 }
 
-std::vector<GkoEntry> ParseGKO(const std::vector<uint8_t>& b) {
-    if (b.size() < 4) throw std::runtime_error("GKO inválido (tamanho insuficiente)");
-    uint32_t count = u32le(&b[0]);
+// Header and TOC through read(pos, dst, n); entries' data is left empty.
+template <class Read>
+static std::vector<GkoEntry> ParseTOC(uint64_t b_size, Read&& read) {
+    if (b_size < 4) throw std::runtime_error("GKO inválido (tamanho insuficiente)");
+    uint8_t hdr[24];
+    read(0, hdr, 4);
+    uint32_t count = u32le(hdr);
     size_t toc_offset = 4;
     std::vector<GkoEntry> out;
-    out.reserve(count);
+    out.reserve((size_t)std::min<uint64_t>(count, (b_size - 4) / 24));
     for (uint32_t i = 0; i < count; ++i) {
-        size_t entry_off = toc_offset + i * 24;
-        if (entry_off + 24 > b.size()) throw std::runtime_error("TOC excede tamanho do arquivo");
+        size_t entry_off = toc_offset + (size_t)i * 24;
+        if (entry_off + 24 > b_size) throw std::runtime_error("TOC excede tamanho do arquivo");
+        read(entry_off, hdr, 24);
         std::array<uint8_t,16> name_raw{};
-        std::copy_n(&b[entry_off], 16, name_raw.begin());
+        std::copy_n(hdr, 16, name_raw.begin());
         std::string name;
         for (int k=0;k<16;k++){ if (name_raw[k]==0) break; name.push_back((char)name_raw[k]); }
-        uint32_t off = u32le(&b[entry_off+16]);
-        uint32_t size = u32le(&b[entry_off+20]);
-        if ((size_t)off + size > b.size()) throw std::runtime_error("Entrada fora dos limites");
-        std::vector<uint8_t> data(&b[off], &b[off+size]);
-        out.push_back(GkoEntry{ name, off, size, std::move(data), name_raw });
+        uint32_t off = u32le(&hdr[16]);
+        uint32_t size = u32le(&hdr[20]);
+        if ((uint64_t)off + size > b_size) throw std::runtime_error("Entrada fora dos limites");
+        out.push_back(GkoEntry{ name, off, size, ByteView{}, name_raw });
     }
     return out;
 }
 
+std::vector<GkoEntry> ParseGKO(const uint8_t* b, size_t b_size) {
+    auto out = ParseTOC(b_size, [b](size_t pos, uint8_t* dst, size_t n) { std::memcpy(dst, b + pos, n); });
+    for (auto& e : out) e.data = ByteView{ b + e.offset, e.size };
+    return out;
+}
+
+std::vector<GkoEntry> ReadGKO_TOC(const SectorStream& s) {
+    return ParseTOC(s.size(), [&s](size_t pos, uint8_t* dst, size_t n) { s.read(pos, dst, n); });
+}
+
+std::vector<GkoEntry> ParseGKO(const std::vector<uint8_t>& b) {
+    return ParseGKO(b.data(), b.size());
+}
+
+GkoArchive OpenGKO(std::vector<uint8_t> bytes) {
+    auto storage = std::make_shared<const std::vector<uint8_t>>(std::move(bytes));
+    GkoArchive ar;
+    ar.entries = ParseGKO(storage->data(), storage->size());
+    ar.storage = std::move(storage);
+    return ar;
+}
+
+GkoArchive OpenGKO(const std::filesystem::path& path) {
+    auto mapped = MapFile(path);
+    GkoArchive ar;
+    ar.entries = ParseGKO(mapped->data(), mapped->size());
+    ar.storage = std::move(mapped);
+    return ar;
+}
+
+GkoArchive OpenGKO(const SectorStream& s) {
+    ByteView whole = s.contiguous();
+    if (whole.empty() && s.size() > 0) return OpenGKO(s.read_all());
+    GkoArchive ar;
+    ar.entries = ParseGKO(whole.data(), whole.size());
+    ar.storage = s.storage();
+    return ar;
+}
+
 int DetectGKOAlignment(const std::vector<GkoEntry>& entries) {
     if (entries.empty()) return 1;
     auto allAligned = [&](int a)->bool {
@@ -58,84 +103,288 @@ static inline size_t AlignUp(size_t x, size_t a) {
     return ((x + a - 1) / a) * a;
 }
 
-static inline std::vector<uint8_t> ReadAllBytes(const std::filesystem::path& p) {
-    std::ifstream f(p, std::ios::binary);
-    if (!f) throw std::runtime_error("Falha ao abrir arquivo: " + p.string());
-    f.seekg(0, std::ios::end);
-    size_t sz = (size_t)f.tellg();
-    f.seekg(0, std::ios::beg);
-    std::vector<uint8_t> buf(sz);
-    f.read((char*)buf.data(), sz);
-    return buf;
+// Name lookups work on UTF-32 so that folder listings convert the same way on
+// Windows (UTF-16 paths) and Linux (UTF-8 paths), independent of the C locale.
+static std::u32string Latin1ToU32(const std::string& s) {
+    std::u32string w; w.reserve(s.size());
+    for (unsigned char c: s) w.push_back((char32_t)c);
+    return w;
 }
 
-std::vector<uint8_t> BuildGKO_PreserveOrder(const std::vector<GkoEntry>& orderEntries,
-                                            const std::filesystem::path& folder) {
-    if (orderEntries.empty())
-        throw std::runtime_error("Arquivo .GKO original não carregado.");
-
-    int align = DetectGKOAlignment(orderEntries);
-    const size_t N = orderEntries.size();
-    const size_t header_size = 4 + N * 24;
-
-    std::vector<uint8_t> toc;
-    std::vector<uint8_t> data_blob;
-
-    size_t cur_off = AlignUp(header_size, (size_t)align);
-
-    auto lower = [](std::string s){ std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c){ return (char)std::tolower(c); }); return s; };
+std::filesystem::path GkoEntryFileName(const GkoEntry& e) {
+    return std::filesystem::path(Latin1ToU32(e.name)).filename();
+}
 
-    // Build a file list
-    std::vector<std::filesystem::path> files;
-    for (auto const& entry: std::filesystem::directory_iterator(folder)) {
-        if (entry.is_regular_file()) files.push_back(entry.path());
+// A folder file name as code points. A name that is not valid in the native
+// encoding (say, raw Latin-1 bytes on Linux, as older extractions wrote them)
+// is read byte for byte as Latin-1 where the platform allows it, and is
+// otherwise empty so that the caller skips it.
+static std::u32string FileNameU32(const std::filesystem::path& name) {
+    try {
+        return name.u32string();
+    } catch (const std::exception&) {
+#ifdef _WIN32
+        return {};
+#else
+        return Latin1ToU32(name.native());
+#endif
     }
+}
 
-    auto Latin1ToWide = [](const std::string& s)->std::wstring{
-        std::wstring w; w.reserve(s.size());
-        for (unsigned char c: s) w.push_back((wchar_t)c);
-        return w;
-    };
-    auto EqualsIgnoreCase = [](const std::wstring& a, const std::wstring& b)->bool{
-        return CompareStringOrdinal(a.c_str(), -1, b.c_str(), -1, TRUE) == CSTR_EQUAL;
-    };
+// Ordinal upper-case fold over the Latin-1 range, matching what
+// CompareStringOrdinal(..., bIgnoreCase=TRUE) does for these characters.
+static std::u32string FoldCase(std::u32string s) {
+    for (auto& c: s) {
+        if ((c >= U'a' && c <= U'z') || (c >= 0xE0 && c <= 0xFE && c != 0xF7)) c -= 0x20;
+        else if (c == 0xFF) c = 0x178;   // ÿ -> Ÿ
+        else if (c == 0xB5) c = 0x39C;   // µ -> Μ
+    }
+    return s;
+}
 
-    for (auto const& e: orderEntries) {
-        std::filesystem::path chosen;
-        std::wstring want = Latin1ToWide(e.name);
+// std::filesystem::path::stem() rule, with both separators as on Windows.
+static std::u32string StemOf(std::u32string name) {
+    size_t sep = name.find_last_of(U"/\\");
+    if (sep != std::u32string::npos) name.erase(0, sep + 1);
+    if (name == U"." || name == U"..") return name;
+    size_t dot = name.rfind(U'.');
+    if (dot == std::u32string::npos || dot == 0) return name;
+    return name.substr(0, dot);
+}
 
-        // Try full filename (case-insensitive)
-        for (auto const& p: files) {
-            if (EqualsIgnoreCase(p.filename().wstring(), want)) { chosen = p; break; }
-        }
-        // Try by stem if not found
-        if (chosen.empty()) {
-            std::wstring wantStem = std::filesystem::path(want).stem().wstring();
-            for (auto const& p: files) {
-                if (EqualsIgnoreCase(p.stem().wstring(), wantStem)) { chosen = p; break; }
+namespace {
+    // Case-insensitive lookup of the files in a folder by full name and by stem.
+    // Keys that more than one file folds to are kept as ambiguous and only
+    // reported if an entry actually resolves through them.
+    class FolderIndex {
+    public:
+        explicit FolderIndex(const std::filesystem::path& folder) {
+            const std::u32string skip = Latin1ToU32(GKO_FOLDER_INDEX);
+            for (auto const& entry: std::filesystem::directory_iterator(folder)) {
+                if (!entry.is_regular_file()) continue;
+                std::u32string name = FileNameU32(entry.path().filename());
+                if (name.empty() || name == skip) continue;
+                size_t idx = files_.size();
+                files_.push_back(entry.path());
+                add(by_stem_, FoldCase(StemOf(name)), idx);
+                add(by_name_, FoldCase(std::move(name)), idx);
             }
         }
-        if (chosen.empty()) {
+
+        // Full filename first, then stem.
+        const std::filesystem::path& resolve(const GkoEntry& e) const {
+            std::u32string want = Latin1ToU32(e.name);
+            if (auto p = find(by_name_, FoldCase(want), e)) return *p;
+            if (auto p = find(by_stem_, FoldCase(StemOf(want)), e)) return *p;
             throw std::runtime_error(std::string("Arquivo correspondente a '") + e.name + "' não encontrado na pasta.");
         }
-        auto bytes = ReadAllBytes(chosen);
+
+    private:
+        static constexpr size_t AMBIGUOUS = SIZE_MAX;
+        using Map = std::unordered_map<std::u32string, size_t>;
+
+        static void add(Map& m, std::u32string key, size_t idx) {
+            auto [it, inserted] = m.emplace(std::move(key), idx);
+            if (!inserted) it->second = AMBIGUOUS;
+        }
+
+        const std::filesystem::path* find(const Map& m, const std::u32string& key, const GkoEntry& e) const {
+            auto it = m.find(key);
+            if (it == m.end()) return nullptr;
+            if (it->second == AMBIGUOUS)
+                throw std::runtime_error(std::string("Mais de um arquivo na pasta corresponde a '") + e.name + "' (nomes iguais ignorando maiúsculas).");
+            return &files_[it->second];
+        }
+
+        std::vector<std::filesystem::path> files_;
+        Map by_name_;
+        Map by_stem_;
+    };
+} // namespace
+
+GkoLayout LayoutGKO(const std::vector<uint64_t>& sizes, int align) {
+    GkoLayout lay;
+    lay.offsets.reserve(sizes.size());
+    size_t cur_off = AlignUp(4 + sizes.size() * 24, (size_t)align);
+    lay.total_size = cur_off;
+    for (uint64_t sz: sizes) {
+        if (cur_off + sz > UINT32_MAX) throw std::runtime_error("GKO excede 4 GB.");
+        lay.offsets.push_back((uint32_t)cur_off);
+        lay.total_size = cur_off + (size_t)sz;
+        cur_off = AlignUp(cur_off + (size_t)sz, (size_t)align);
+    }
+    return lay;
+}
+
+// Count + TOC for `entries` at the offsets/sizes of `lay`; `o` holds 4 + N*24 bytes.
+static void WriteHeader(uint8_t* o, const std::vector<GkoEntry>& entries,
+                        const GkoLayout& lay, const std::vector<uint64_t>& sizes) {
+    const size_t N = entries.size();
+    w32le(o, (uint32_t)N);
+    for (size_t i = 0; i < N; ++i) {
         // name field (16 bytes) preserved
-        std::array<uint8_t,16> name_field = e.name_raw;
+        uint8_t* t = o + 4 + i * 24;
+        std::copy(entries[i].name_raw.begin(), entries[i].name_raw.end(), t);
+        w32le(t + 16, lay.offsets[i]);
+        w32le(t + 20, (uint32_t)sizes[i]);
+    }
+}
 
-        toc.insert(toc.end(), name_field.begin(), name_field.end());
-        p32(toc, (uint32_t)cur_off);
-        p32(toc, (uint32_t)bytes.size());
+uint64_t HashGKOEntry(const uint8_t* p, size_t n) {
+    // Word-at-a-time multiplicative mix; only used to tell entries apart.
+    const uint64_t K = 0x9E3779B97F4A7C15ull;
+    uint64_t h = 0xCBF29CE484222325ull ^ ((uint64_t)n * K);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w; std::memcpy(&w, p + i, 8);
+        h = (h ^ w) * K;
+        h ^= h >> 29;
+    }
+    uint64_t w = 0;
+    if (i < n) std::memcpy(&w, p + i, n - i);
+    h = (h ^ w) * K;
+    return h ^ (h >> 32);
+}
+
+static long long WriteTimeOf(const std::filesystem::path& p) {
+    return (long long)std::filesystem::last_write_time(p).time_since_epoch().count();
+}
 
-        size_t needed_pad = cur_off - (4 + N*24 + data_blob.size());
-        if (needed_pad > 0) data_blob.insert(data_blob.end(), needed_pad, 0);
+namespace {
+    struct FolderRecord {
+        bool valid = false;
+        uint64_t size = 0;
+        uint64_t hash = 0;
+        long long mtime = 0;
+    };
+}
 
-        data_blob.insert(data_blob.end(), bytes.begin(), bytes.end());
-        cur_off = AlignUp(cur_off + bytes.size(), (size_t)align);
+// One line per entry: index, size, hash (hex), write time, name.
+void WriteGKOFolderIndex(const std::vector<GkoEntry>& entries, const std::filesystem::path& folder) {
+    std::ostringstream ss;
+    ss << "# gko-index 1\n";
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& e = entries[i];
+        std::filesystem::path file = folder / GkoEntryFileName(e);
+        ss << i << '\t' << e.data.size() << '\t' << std::hex << HashGKOEntry(e.data.data(), e.data.size())
+           << std::dec << '\t' << WriteTimeOf(file) << '\t' << e.name << '\n';
     }
+    std::string text = ss.str();
+    WriteAllBytes(folder / GKO_FOLDER_INDEX, (const uint8_t*)text.data(), text.size());
+}
 
-    std::vector<uint8_t> out;
-    p32(out, (uint32_t)N);
-    out.insert(out.end(), toc.begin(), toc.end());
-    out.insert(out.end(), data_blob.begin(), data_blob.end());
-    return out;
+// Records whose index and name match `entries`; a missing or foreign index
+// just yields no records.
+static std::vector<FolderRecord> LoadFolderIndex(const std::vector<GkoEntry>& entries,
+                                                 const std::filesystem::path& folder) {
+    std::vector<FolderRecord> recs(entries.size());
+    std::filesystem::path p = folder / GKO_FOLDER_INDEX;
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(p, ec)) return recs;
+    std::vector<uint8_t> bytes = ReadAllBytes(p);
+    std::istringstream in(std::string(bytes.begin(), bytes.end()));
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ls(line);
+        size_t idx; FolderRecord r;
+        if (!(ls >> idx >> r.size >> std::hex >> r.hash >> std::dec >> r.mtime)) continue;
+        if (idx >= entries.size() || ls.get() != '\t') continue;
+        std::string name;
+        std::getline(ls, name);
+        if (name != entries[idx].name) continue;
+        r.valid = true;
+        recs[idx] = r;
+    }
+    return recs;
+}
+
+GkoRepackStats WriteGKO_Incremental(const std::vector<GkoEntry>& base,
+                                    const std::filesystem::path& folder,
+                                    const std::filesystem::path& outPath,
+                                    bool trust_mtime,
+                                    unsigned threads) {
+    if (base.empty())
+        throw std::runtime_error("Arquivo .GKO original não carregado.");
+
+    int align = DetectGKOAlignment(base);
+    const size_t N = base.size();
+
+    FolderIndex index(folder);
+    std::vector<FolderRecord> recs;
+    if (trust_mtime) recs = LoadFolderIndex(base, folder);
+
+    // Classify from metadata only: a size change means the file must be read,
+    // a matching index record means it need not be. Hashing the base entries
+    // dominates here, so entries are classified concurrently.
+    enum class Source { Base, Compare, File };
+    std::vector<Source> source(N);
+    std::vector<std::filesystem::path> chosen(N);
+    std::vector<uint64_t> sizes(N);
+    ParallelFor(N, threads, [&](size_t i) {
+        const GkoEntry& e = base[i];
+        chosen[i] = index.resolve(e);
+        sizes[i] = std::filesystem::file_size(chosen[i]);
+        if (sizes[i] != e.data.size()) { source[i] = Source::File; return; }
+        source[i] = Source::Compare;
+        if (trust_mtime && recs[i].valid && recs[i].size == sizes[i] &&
+            recs[i].mtime == WriteTimeOf(chosen[i]) &&
+            recs[i].hash == HashGKOEntry(e.data.data(), e.data.size()))
+            source[i] = Source::Base;
+    });
+    GkoRepackStats st;
+    st.by_mtime = (size_t)std::count(source.begin(), source.end(), Source::Base);
+    GkoLayout lay = LayoutGKO(sizes, align);
+
+    std::vector<uint8_t> header(4 + N * 24, 0);
+    WriteHeader(header.data(), base, lay, sizes);
+
+    // Files are loaded (mapped, compared with the base entry or paged in) by
+    // the workers a window at a time, then written in order; only one window
+    // of files is held at once.
+    const size_t window = std::max<size_t>(16, (size_t)ResolveThreadCount(threads, N) * 4);
+    std::vector<std::shared_ptr<const MappedFile>> files(N);
+    std::vector<char> same(N, 0);
+
+    AtomicFileWriter out(outPath, lay.total_size, true);
+    out.write(header.data(), header.size());
+    for (size_t w0 = 0; w0 < N; w0 += window) {
+        const size_t w1 = std::min(N, w0 + window);
+        ParallelFor(w1 - w0, threads, [&](size_t k) {
+            const size_t i = w0 + k;
+            if (source[i] == Source::Base) return;
+            auto src = MapFile(chosen[i]);
+            if (src->size() != sizes[i])
+                throw std::runtime_error("Arquivo alterado durante o empacotamento: " + chosen[i].string());
+            const ByteView& orig = base[i].data;
+            if (source[i] == Source::Compare) {
+                same[i] = orig.empty() || std::memcmp(src->data(), orig.data(), orig.size()) == 0;
+            } else {
+                volatile uint8_t sink = 0;
+                for (size_t p = 0; p < src->size(); p += 4096) sink = sink + src->data()[p];
+            }
+            files[i] = std::move(src);
+        });
+        for (size_t i = w0; i < w1; ++i) {
+            out.write_zeros(lay.offsets[i] - (size_t)out.written());
+            const ByteView& orig = base[i].data;
+            if (source[i] == Source::Base) {
+                out.write(orig.data(), orig.size());
+                ++st.reused;
+                st.bytes_reused += orig.size();
+                continue;
+            }
+            out.write(files[i]->data(), files[i]->size());
+            st.bytes_read += files[i]->size();
+            if (same[i]) {
+                ++st.reused;
+                st.bytes_reused += orig.size();
+            } else {
+                ++st.replaced;
+            }
+            files[i].reset();
+        }
+    }
+    out.commit();
+    return st;
 }
@@ -4,15 +4,85 @@
 #include <vector>
 #include <filesystem>
 #include <array>
+#include <memory>
+#include "fileio.h"
+#include "disc.h"
+
 struct GkoEntry {
     std::string name;
     uint32_t offset;
     uint32_t size;
-    std::vector<uint8_t> data;
+    ByteView data;                   // points into the parsed buffer; copy with data.to_vector()
     std::array<uint8_t,16> name_raw;
 };
 
+// Parsed archive that owns the buffer its entries point into.
+struct GkoArchive {
+    std::shared_ptr<const void> storage;
+    std::vector<GkoEntry> entries;
+};
+
+// Entries view `bytes`, which must outlive them.
+std::vector<GkoEntry> ParseGKO(const uint8_t* bytes, size_t size);
 std::vector<GkoEntry> ParseGKO(const std::vector<uint8_t>& bytes);
+// A temporary would leave the entries dangling; use OpenGKO to keep the bytes.
+std::vector<GkoEntry> ParseGKO(std::vector<uint8_t>&& bytes) = delete;
+// Takes ownership of `bytes` and parses it without copying entry data.
+GkoArchive OpenGKO(std::vector<uint8_t> bytes);
+// Memory-maps the file; entries point straight into the mapping.
+GkoArchive OpenGKO(const std::filesystem::path& path);
+// A file inside a disc image: entries point into the image's mapping when the
+// file's bytes are contiguous there (2048-byte images), otherwise the file is
+// read into memory once.
+GkoArchive OpenGKO(const SectorStream& s);
+// Header and TOC only, read through `s`; entries' `data` is empty and their
+// bytes are [offset, offset + size) of `s`.
+std::vector<GkoEntry> ReadGKO_TOC(const SectorStream& s);
+
 int DetectGKOAlignment(const std::vector<GkoEntry>& entries);
-std::vector<uint8_t> BuildGKO_PreserveOrder(const std::vector<GkoEntry>& orderEntries,
-                                            const std::filesystem::path& folder);
+
+// File an entry is extracted to inside a folder: its name, Latin-1 in the
+// archive, as a native path (UTF-8 on Linux, UTF-16 on Windows), without any
+// directory part. Repacking looks names up the same way.
+std::filesystem::path GkoEntryFileName(const GkoEntry& e);
+
+// Archive layout for a given list of entry sizes: each entry starts at the next
+// `align` boundary after the header/previous entry, no padding after the last.
+struct GkoLayout {
+    std::vector<uint32_t> offsets;
+    size_t total_size = 0;
+};
+GkoLayout LayoutGKO(const std::vector<uint64_t>& sizes, int align);
+
+// Incremental repack against the archive the folder was extracted from.
+// Extraction records each file's size, content hash and write time in
+// GKO_FOLDER_INDEX inside the folder. On repack an entry whose file still has
+// the base entry's size is checked first against that record (same size and
+// write time, and the recorded hash matches the base entry: reused without
+// touching the file), then by comparing the file to the base entry's bytes.
+// Unchanged entries are copied from `base` and only the other files are read,
+// by `threads` workers (0 = one per hardware thread). The output is the archive
+// a full rebuild from the folder would give: entries in `base` order, at its
+// alignment (LayoutGKO), with each entry's bytes taken from its file.
+inline constexpr const char* GKO_FOLDER_INDEX = ".gko_index";
+
+struct GkoRepackStats {
+    size_t reused = 0;           // entries copied from the base archive
+    size_t replaced = 0;         // entries taken from the folder
+    size_t by_mtime = 0;         // reused entries decided without reading the file
+    uint64_t bytes_read = 0;     // bytes read from files in the folder
+    uint64_t bytes_reused = 0;   // bytes copied from the base archive
+};
+
+uint64_t HashGKOEntry(const uint8_t* data, size_t size);
+
+// Call after extracting `entries` (by file name) into `folder`.
+void WriteGKOFolderIndex(const std::vector<GkoEntry>& entries, const std::filesystem::path& folder);
+
+// `base` entries must still point at valid data. Set trust_mtime = false to
+// always compare file contents.
+GkoRepackStats WriteGKO_Incremental(const std::vector<GkoEntry>& base,
+                                    const std::filesystem::path& folder,
+                                    const std::filesystem::path& outPath,
+                                    bool trust_mtime = true,
+                                    unsigned threads = 1);
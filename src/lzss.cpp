@@ -1,6 +1,12 @@
 #include "lzss.h"
+#include "lzss_match.h"
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
+#include <type_traits>
+#include <variant>
 
 namespace {
     constexpr int WINDOW_SIZE = 4096;
@@ -8,101 +14,579 @@ namespace {
     constexpr int MIN_MATCH   = 3;
     constexpr int MAX_MATCH   = 18;
     constexpr int HASH_LEN    = 3;
+    // The decoder's ring starts zeroed, as if 4096 zeros preceded the stream.
+    // The compressor puts ZERO_PREFIX of them in front of the input: every
+    // string starting further back is the same MAX_MATCH zeros and is never
+    // nearer, so this exposes exactly the matches the ring allows.
+    constexpr int ZERO_PREFIX = MAX_MATCH;
+
+    // Search work counters behind LzssStats. The finders and parsers call
+    // these hooks unconditionally; with NoSearchStats (the default) they
+    // compile to nothing, so only a compressor built for stats pays for them.
+    struct NoSearchStats {
+        void on_search() const {}
+        void on_candidate() const {}
+        void on_cutoff() const {}
+        void on_lazy_deferral() const {}
+    };
+    struct SearchStats {
+        mutable uint64_t searches = 0, candidates = 0, cutoffs = 0, lazy_deferrals = 0;
+        void on_search() const { ++searches; }
+        void on_candidate() const { ++candidates; }
+        void on_cutoff() const { ++cutoffs; }
+        void on_lazy_deferral() const { ++lazy_deferrals; }
+    };
+
+    // Hash-chain match finder over the 4 KB window: head[] holds the most recent
+    // position for each hash slot, prev[] links each position (mod WINDOW_SIZE)
+    // to the previous one in the same slot. Both are flat arrays, so inserting
+    // and walking candidates never touch the allocator.
+    constexpr int HASH_BITS   = 13;
+    constexpr int HASH_SIZE   = 1 << HASH_BITS;
+    constexpr int WINDOW_MASK = WINDOW_SIZE - 1;
 
     static inline uint32_t hash3(const uint8_t* b) {
-        return (uint32_t)((b[0] * 0x1F1F) + (b[1] * 0x1F) + b[2]);
+        uint32_t v = (uint32_t)b[0] << 16 | (uint32_t)b[1] << 8 | b[2];
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    static inline bool same3(const uint8_t* a, const uint8_t* b) {
+        return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
     }
 
-    struct IndexBucket {
-        std::deque<int> pos;
+    template <class Stats = NoSearchStats>
+    struct BasicMatchFinder : Stats {
+        const uint8_t* src;
+        int n;
+        int chain_limit;
+        std::vector<int> head;
+        std::vector<int> prev;
+
+        // `n` is the number of valid bytes at `src`; a stream raises it as input arrives.
+        BasicMatchFinder(const uint8_t* data, int size, int bucket_limit, int max_candidates)
+            : src(data), n(size),
+              chain_limit(std::max(1, std::min(bucket_limit, max_candidates))),
+              head(HASH_SIZE, -1), prev(WINDOW_SIZE, -1) {}
+
+        void add_pos(int j) {
+            if (j < 0 || j + HASH_LEN > n) return;
+            uint32_t h = hash3(&src[j]);
+            prev[j & WINDOW_MASK] = head[h];
+            head[h] = j;
+        }
+
+        // Rebases every stored position after the first `shift` bytes (a
+        // multiple of WINDOW_SIZE) were dropped from the front of `src`.
+        // Positions that fall off were already outside the window.
+        void slide(int shift) {
+            for (int& p : head) p = p >= shift ? p - shift : -1;
+            for (int& p : prev) p = p >= shift ? p - shift : -1;
+            n -= shift;
+        }
+
+        // Walks the chain newest-first. Only positions whose first three bytes
+        // really match count as candidates, and at most chain_limit of them
+        // are compared.
+        std::pair<int,int> find_best(int i) const {
+            int remaining = n - i;
+            if (remaining < MIN_MATCH) return {0,0};
+            this->on_search();
+            const uint8_t* cur = &src[i];
+            const int win_min = i - WINDOW_SIZE;
+            const int max_len = std::min(MAX_MATCH, remaining);
+            int best_len = 0;
+            int best_back = 0;
+            int checked = 0;
+            int pos = head[hash3(cur)];
+            while (pos >= win_min && pos >= 0) {
+                int next = prev[pos & WINDOW_MASK];
+                if (pos < i && same3(&src[pos], cur)) {
+                    this->on_candidate();
+                    int l = MatchLength(&src[pos], cur, MIN_MATCH, max_len, remaining);
+                    if (l > best_len) {
+                        best_len = l;
+                        best_back = i - pos;
+                        if (best_len == MAX_MATCH) break;
+                    }
+                    if (++checked >= chain_limit) { this->on_cutoff(); break; }
+                }
+                if (next >= pos) break;
+                pos = next;
+            }
+            return {best_len, best_back};
+        }
+
+        std::pair<int,int> find_and_add(int i) {
+            auto best = find_best(i);
+            add_pos(i);
+            return best;
+        }
+    };
+
+    // Binary-tree match finder (LZ77 "bt3" style). Positions with the same
+    // 3-byte hash share one tree, ordered by their next MAX_MATCH bytes, and
+    // every insertion makes the new position the root, so each node is newer
+    // than everything below it. A search walks a single root-to-leaf path,
+    // which passes both sorted neighbours of the current string: the longest
+    // match is always found, at its nearest distance, without the hash chain's
+    // candidate limit. Nodes that leave the window cut off their (older)
+    // subtrees. max_candidates bounds the walk depth.
+    template <class Stats = NoSearchStats>
+    struct BasicTreeMatchFinder : Stats {
+        const uint8_t* src;
+        int n;
+        int depth_limit;
+        std::vector<int> head;
+        std::vector<int> left;    // per window slot: subtree of smaller strings
+        std::vector<int> right;   // per window slot: subtree of greater strings
+
+        BasicTreeMatchFinder(const uint8_t* data, int size, int /*bucket_limit*/, int max_candidates)
+            : src(data), n(size), depth_limit(std::max(1, max_candidates)),
+              head(HASH_SIZE, -1), left(WINDOW_SIZE, -1), right(WINDOW_SIZE, -1) {}
+
+        // Inserts j at the root of its tree, splitting the old tree into the
+        // parts below and above j's string. A node equal to j over the compared
+        // length is replaced by j (same string, nearer).
+        void add_pos(int j) { insert(j); }
+
+        // find_best(i) followed by add_pos(i), in a single walk: the insertion
+        // path is the search path.
+        std::pair<int,int> find_and_add(int i) {
+            if (i + HASH_LEN > n) return find_best(i);
+            this->on_search();
+            auto best = insert(i);
+            if (best.first < MIN_MATCH) return {0,0};
+            return best;
+        }
+
+        // Returns the longest match met on the way (nearest first).
+        std::pair<int,int> insert(int j) {
+            if (j < 0 || j + HASH_LEN > n) return {0,0};
+            const uint8_t* cur = &src[j];
+            uint32_t h = hash3(cur);
+            int node = head[h];
+            head[h] = j;
+            int* lt = &left[j & WINDOW_MASK];
+            int* gt = &right[j & WINDOW_MASK];
+            // j reuses the slot of j - WINDOW_SIZE, so that node leaves the
+            // tree here; it is still a valid match for j itself.
+            const int win_min = j - WINDOW_SIZE + 1;
+            const int max_len = std::min(MAX_MATCH, n - j);
+            int best_len = 0, best_back = 0;
+            int len_lt = 0, len_gt = 0;
+            for (int depth = depth_limit; ; --depth) {
+                if (node < win_min || node < 0 || depth == 0) {
+                    if (depth == 0 && node >= 0 && node >= win_min) this->on_cutoff();
+                    if (node == j - WINDOW_SIZE && node >= 0 && depth > 0) {
+                        int len = MatchLength(&src[node], cur, std::min(len_lt, len_gt), max_len, n - j);
+                        if (len > best_len) { best_len = len; best_back = WINDOW_SIZE; }
+                    }
+                    *lt = *gt = -1;
+                    return {best_len, best_back};
+                }
+                const uint8_t* pb = &src[node];
+                this->on_candidate();
+                int len = MatchLength(pb, cur, std::min(len_lt, len_gt), max_len, n - j);
+                if (len > best_len) { best_len = len; best_back = j - node; }
+                if (len == max_len) {
+                    *lt = left[node & WINDOW_MASK];
+                    *gt = right[node & WINDOW_MASK];
+                    return {best_len, best_back};
+                }
+                if (pb[len] < cur[len]) {
+                    *lt = node; lt = &right[node & WINDOW_MASK]; node = *lt; len_lt = len;
+                } else {
+                    *gt = node; gt = &left[node & WINDOW_MASK]; node = *gt; len_gt = len;
+                }
+            }
+        }
+
+        // Read-only walk along the path add_pos(i) would take.
+        std::pair<int,int> find_best(int i) const {
+            int remaining = n - i;
+            if (remaining < MIN_MATCH) return {0,0};
+            const uint8_t* cur = &src[i];
+            const int win_min = i - WINDOW_SIZE;
+            const int max_len = std::min(MAX_MATCH, remaining);
+            this->on_search();
+            int best_len = 0, best_back = 0;
+            int len_lt = 0, len_gt = 0;
+            int node = head[hash3(cur)];
+            for (int depth = depth_limit; depth > 0 && node >= win_min && node >= 0 && node < i; --depth) {
+                const uint8_t* pb = &src[node];
+                this->on_candidate();
+                int len = MatchLength(pb, cur, std::min(len_lt, len_gt), max_len, remaining);
+                if (len > best_len) {
+                    best_len = len;
+                    best_back = i - node;
+                }
+                if (len == max_len) break;
+                if (pb[len] < cur[len]) { len_lt = len; node = right[node & WINDOW_MASK]; }
+                else                    { len_gt = len; node = left[node & WINDOW_MASK]; }
+            }
+            if (best_len < MIN_MATCH) return {0,0};
+            return {best_len, best_back};
+        }
+
+        void slide(int shift) {
+            for (int& p : head)  p = p >= shift ? p - shift : -1;
+            for (int& p : left)  p = p >= shift ? p - shift : -1;
+            for (int& p : right) p = p >= shift ? p - shift : -1;
+            n -= shift;
+        }
+    };
+
+    using MatchFinder = BasicMatchFinder<>;
+    using TreeMatchFinder = BasicTreeMatchFinder<>;
+
+    // Token output: one control byte per group of 8 tokens, MSB first,
+    // bit set = match (2 bytes), bit clear = literal (1 byte).
+    class GroupWriter {
+    public:
+        explicit GroupWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+        void literal(uint8_t b) {
+            begin_token();
+            out_.push_back(b);
+            end_token();
+        }
+        void match(int distance, int length) {
+            begin_token();
+            control_ |= (uint8_t)(0x80 >> bits_);
+            out_.push_back((uint8_t)(distance & 0xFF));
+            out_.push_back((uint8_t)(((distance >> 8) & 0x0F) << 4 | ((length - 3) & 0x0F)));
+            end_token();
+        }
+        void finish() {
+            if (bits_ != 0) out_[control_pos_] = control_;
+        }
+        // Moves every byte of completed groups to `dst`; an open group stays.
+        void take_finished(std::vector<uint8_t>& dst) {
+            size_t done = bits_ != 0 ? control_pos_ : out_.size();
+            dst.insert(dst.end(), out_.begin(), out_.begin() + done);
+            out_.erase(out_.begin(), out_.begin() + done);
+            control_pos_ -= std::min(control_pos_, done);
+        }
+
+    private:
+        void begin_token() {
+            if (bits_ != 0) return;
+            control_ = 0;
+            out_.push_back(0);
+            control_pos_ = out_.size() - 1;
+        }
+        void end_token() {
+            if (++bits_ == 8) {
+                out_[control_pos_] = control_;
+                bits_ = 0;
+            }
+        }
+
+        std::vector<uint8_t>& out_;
+        size_t control_pos_ = 0;
+        uint8_t control_ = 0;
+        int bits_ = 0;
     };
 
-    using IndexMap = std::unordered_map<uint32_t, IndexBucket>;
-
-    static inline void add_pos(IndexMap& index, const std::vector<uint8_t>& src, int n, int j, int bucket_limit) {
-        if (j < 0 || j + HASH_LEN > n) return;
-        uint32_t key = hash3(&src[j]);
-        auto& bucket = index[key].pos;
-        int win_min = j - WINDOW_SIZE;
-        while (!bucket.empty() && bucket.front() <= win_min) bucket.pop_front();
-        bucket.push_back(j);
-        while ((int)bucket.size() > bucket_limit) bucket.pop_front();
-    }
-
-    static inline std::pair<int,int> find_best(const std::vector<uint8_t>& src, int i, int n,
-                                               IndexMap& index, int max_candidates) {
-        int remaining = n - i;
-        if (remaining < MIN_MATCH) return {0,0};
-        uint32_t key = hash3(&src[i]);
-        auto it = index.find(key);
-        if (it == index.end() || it->second.pos.empty()) return {0,0};
-        const auto& bucket = it->second.pos;
-        int best_len = 0;
-        int best_back = 0;
-        int checked = 0;
-        for (auto rit = bucket.rbegin(); rit != bucket.rend(); ++rit) {
-            int pos = *rit;
-            if (pos < i - WINDOW_SIZE || pos >= i) continue;
-            int max_len = std::min(MAX_MATCH, n - i);
-            int l = MIN_MATCH;
-            while (l < max_len && src[pos + l] == src[i + l]) {
-                ++l;
-            }
-            if (l > best_len) {
-                best_len = l;
-                best_back = i - pos;
-                if (best_len == MAX_MATCH) break;
-            }
-            checked++;
-            if (checked >= max_candidates) break;
-        }
-        return {best_len, best_back};
+    // Ring offset the decoder reads from for a match `back` bytes behind
+    // position i of the compressor's buffer (input preceded by ZERO_PREFIX).
+    static inline int ring_distance(int i, int back) {
+        return (RING_INIT - ZERO_PREFIX + i - back) & 0x0FFF;
     }
-} // namespace
 
-std::vector<uint8_t> DecompressLZSS_PSX(const std::vector<uint8_t>& data, size_t out_len_hint) {
-    std::vector<uint8_t> out;
-    out.reserve(out_len_hint ? out_len_hint : data.size() * 4 + 64);
+    // Indexes the zero prefix; done once, before the first token is parsed.
+    template <class Finder>
+    static void index_zero_prefix(Finder& mf) {
+        for (int j = 0; j < ZERO_PREFIX; ++j) mf.add_pos(j);
+    }
 
-    std::vector<uint8_t> dict(0x1000, 0);
-    int dict_pos = RING_INIT;
-    size_t src = 0, n = data.size();
+    // Longest match (and its distance) at every input position, with every
+    // position indexed, as the optimal parser needs the full match graph.
+    template <class Finder>
+    static std::pair<std::vector<uint8_t>, std::vector<uint16_t>> longest_matches(Finder& mf, int n) {
+        std::vector<uint8_t> lens(n, 0);
+        std::vector<uint16_t> backs(n, 0);
+        for (int i = 0; i < n; ++i) {
+            auto [len, back] = mf.find_and_add(i);
+            if (len >= MIN_MATCH) {
+                lens[i] = (uint8_t)len;
+                backs[i] = (uint16_t)back;
+            }
+        }
+        return {std::move(lens), std::move(backs)};
+    }
+
+    // Shortest path over the token graph with the exact cost of the format:
+    // literal = 1 flag bit + 8 bits, match = 1 flag bit + 16 bits. A match of
+    // length L found at i also covers every length 3..L at the same distance.
+    // Returns the chosen token length at each position (1 = literal).
+    static std::vector<uint8_t> optimal_lengths(const std::vector<uint8_t>& lens, int n) {
+        constexpr uint32_t LITERAL_BITS = 9;
+        constexpr uint32_t MATCH_BITS   = 17;
+        std::vector<uint32_t> cost(n + 1, 0);
+        std::vector<uint8_t> choice(n, 1);
+        for (int i = n - 1; i >= 0; --i) {
+            uint32_t best = cost[i + 1] + LITERAL_BITS;
+            uint8_t pick = 1;
+            for (int l = MIN_MATCH; l <= lens[i]; ++l) {
+                uint32_t c = cost[i + l] + MATCH_BITS;
+                if (c <= best) { best = c; pick = (uint8_t)l; }
+            }
+            cost[i] = best;
+            choice[i] = pick;
+        }
+        return choice;
+    }
+
+    // Greedy parse (with the optional one-step lazy check) of the tokens that
+    // start before `stop`; returns the position after the last one. Every
+    // decision only looks at mf.n through positions up to i + MAX_MATCH + HASH_LEN - 1,
+    // so a stream that keeps that much lookahead parses exactly like the whole buffer.
+    template <class Finder>
+    static int parse_greedy(Finder& mf, GroupWriter& w, bool lazy_matching, int i, int stop) {
+        const uint8_t* data = mf.src;
+        const int n = mf.n;
+        auto add_up_to = [&](int from, int count) {
+            int limit = std::min(from + count, n - (HASH_LEN - 1));
+            for (int j = from; j < limit; ++j) mf.add_pos(j);
+        };
+
+        while (i < stop) {
+            // Without the lazy look at i + 1, i is always indexed next, so search and insert at once.
+            auto [best_len, best_back] = lazy_matching ? mf.find_best(i) : mf.find_and_add(i);
+            const int indexed = lazy_matching ? i : i + 1;
 
-    auto getb = [&]() -> uint8_t {
-        if (src >= n) throw std::runtime_error("EOF during LZSS read");
-        return data[src++];
+            if (lazy_matching && best_len == 3 && i + 1 < n) {
+                auto fb_next = mf.find_best(i + 1);
+                if (fb_next.first >= 4) {
+                    mf.on_lazy_deferral();
+                    // Emit literal
+                    w.literal(data[i]);
+                    if (i <= n - HASH_LEN) mf.add_pos(i);
+                    ++i;
+                    continue;
+                }
+            }
+
+            if (best_len >= MIN_MATCH) {
+                w.match(ring_distance(i, best_back), best_len);
+                add_up_to(indexed, i + best_len - indexed);
+                i += best_len;
+            } else {
+                w.literal(data[i]);
+                if (indexed == i && i <= n - HASH_LEN) mf.add_pos(i);
+                ++i;
+            }
+        }
+        return i;
+    }
+
+    // Number of consecutive literal flags (clear bits) starting at `bit`.
+    static inline int literal_run(uint8_t flags, int bit) {
+        int run = 1;
+        while (bit + run < 8 && (flags & (0x80 >> (bit + run))) == 0) ++run;
+        return run;
+    }
+
+    // Back-distance of the match token (b1, b2) at absolute output position
+    // pos. The ring always holds the last 4096 output bytes (zeros before the
+    // stream start), so a ring offset is just a distance. Ring slot == write
+    // slot means the oldest byte, 4096 back.
+    static inline size_t match_distance(uint64_t pos, uint8_t b1, uint8_t b2) {
+        const int off = ((b2 & 0xF0) << 4) | b1;
+        const int ring_pos = (int)((RING_INIT + pos) & 0x0FFF);
+        size_t dist = (size_t)((ring_pos - off) & 0x0FFF);
+        return dist ? dist : WINDOW_SIZE;
+    }
+
+    // History seen by one feed() call: bytes already written to this call's
+    // output buffer, and before that the ring as it was when the call started
+    // (the ring is only brought up to date when the call returns).
+    struct History {
+        uint8_t* out;
+        const uint8_t* ring;
+        uint64_t ring_base;   // absolute position of out[0]
+
+        // Copies `length` bytes from `dist` back to out[q..].
+        inline void copy(size_t q, size_t dist, size_t length) const {
+            size_t i = 0;
+            if (dist > q) {
+                // Starts before this buffer: take those bytes from the ring.
+                size_t from_ring = std::min(length, dist - q);
+                for (; i < from_ring; ++i)
+                    out[q + i] = ring[(RING_INIT + ring_base + q + i - dist) & WINDOW_MASK];
+            }
+            if (dist >= length) {
+                std::memcpy(out + q + i, out + q + i - dist, length - i);
+            } else {
+                for (; i < length; ++i) out[q + i] = out[q + i - dist];
+            }
+        }
+
+        // Same as copy() for a whole token, but may write up to MAX_MATCH bytes
+        // past the match; the caller guarantees that room and overwrites it.
+        inline void copy_fast(size_t q, size_t dist, size_t length) const {
+            if (dist >= (size_t)MAX_MATCH && dist <= q) {
+                std::memcpy(out + q, out + q - dist, 16);
+                std::memcpy(out + q + 16, out + q - dist + 16, 2);
+                return;
+            }
+            copy(q, dist, length);
+        }
     };
+} // namespace
 
-    while (true) {
-        if (out_len_hint && out.size() >= out_len_hint) break;
-        if (src >= n) break;
-        uint8_t flags = getb();
-        uint8_t mask = 0x80;
-        while (mask) {
-            if (out_len_hint && out.size() >= out_len_hint) break;
+LzssDecoder::LzssDecoder(uint64_t out_limit) : limit_(out_limit) {
+    ring_.fill(0);
+}
+
+void LzssDecoder::reset() {
+    *this = LzssDecoder(limit_);
+}
+
+bool LzssDecoder::finished() const {
+    return limit_ && total_ >= limit_ && match_left_ == 0;
+}
+
+LzssDecoder::Progress LzssDecoder::feed(const uint8_t* in, size_t n, uint8_t* out, size_t cap) {
+    // Worst case one flag group expands to 8 matches of MAX_MATCH bytes.
+    constexpr size_t GROUP_MAX_OUT = 8 * MAX_MATCH;
+    // Fast path reads up to 8 literal bytes at once, so keep that much extra input.
+    constexpr size_t GROUP_MAX_IN  = 1 + 8 * 2 + 8;
+
+    const History h{ out, ring_.data(), total_ };
+    size_t src = 0, q = 0;
+
+    for (;;) {
+        if (match_left_) {
+            size_t len = std::min(match_left_, cap - q);
+            if (len == 0) break;
+            h.copy(q, match_dist_, len);
+            q += len; match_left_ -= len;
+            continue;
+        }
+        // The limit is checked before every token, so a match started below it runs to the end.
+        if (limit_ && total_ + q >= limit_) break;
+
+        if (bit_ == 8) {
             if (src >= n) break;
-            if ((flags & mask) == 0) {
-                uint8_t b = getb();
-                out.push_back(b);
-                dict[dict_pos] = b;
-                dict_pos = (dict_pos + 1) & 0xFFF;
-            } else {
-                if (src + 1 > n) return out;
-                uint8_t b1 = getb();
-                if (src >= n) return out;
-                uint8_t b2 = getb();
-                int length = (b2 & 0x0F) + 3;
-                int off = ((b2 & 0xF0) << 4) | b1;
-                for (int i = 0; i < length; ++i) {
-                    uint8_t v = dict[(off + i) & 0x0FFF];
-                    out.push_back(v);
-                    dict[dict_pos] = v;
-                    dict_pos = (dict_pos + 1) & 0x0FFF;
+            flags_ = in[src++];
+            bit_ = 0;
+
+            if (n - src >= GROUP_MAX_IN && cap - q >= GROUP_MAX_OUT + MAX_MATCH &&
+                (!limit_ || total_ + q + GROUP_MAX_OUT <= limit_)) {
+                // Whole group fits in input and output and stays below the limit: no per-token checks.
+                for (int bit = 0; bit < 8; ) {
+                    if ((flags_ & (0x80 >> bit)) == 0) {
+                        int run = literal_run(flags_, bit);
+                        std::memcpy(out + q, in + src, 8);
+                        q += run; src += run; bit += run;
+                    } else {
+                        uint8_t b1 = in[src++];
+                        uint8_t b2 = in[src++];
+                        h.copy_fast(q, match_distance(total_ + q, b1, b2), (size_t)(b2 & 0x0F) + 3);
+                        q += (b2 & 0x0F) + 3;
+                        ++bit;
+                    }
                 }
+                bit_ = 8;
+                continue;
+            }
+        }
+
+        // One token at a time, suspending wherever input or output runs out.
+        if ((flags_ & (0x80 >> bit_)) == 0) {
+            if (src >= n || q >= cap) break;
+            size_t run = std::min<size_t>({ (size_t)literal_run(flags_, bit_), n - src, cap - q });
+            if (limit_) run = std::min<size_t>(run, limit_ - (total_ + q));
+            std::memcpy(out + q, in + src, run);
+            q += run; src += run; bit_ += (int)run;
+        } else {
+            if (!have_b1_) {
+                if (src >= n) break;
+                b1_ = in[src++];
+                have_b1_ = true;
             }
-            mask >>= 1;
+            if (src >= n) break;
+            uint8_t b2 = in[src++];
+            have_b1_ = false;
+            match_dist_ = match_distance(total_ + q, b1_, b2);
+            match_left_ = (size_t)(b2 & 0x0F) + 3;
+            ++bit_;
         }
     }
+
+    // Bring the ring up to date with the tail of what was written.
+    size_t keep = std::min<size_t>(q, WINDOW_SIZE);
+    for (size_t i = q - keep; i < q; ++i)
+        ring_[(RING_INIT + total_ + i) & WINDOW_MASK] = out[i];
+    total_ += q;
+    return Progress{ src, q };
+}
+
+void LzssStats::add(const LzssStats& o) {
+    input_bytes += o.input_bytes;
+    output_bytes += o.output_bytes;
+    literals += o.literals;
+    matches += o.matches;
+    for (size_t k = 0; k < match_length.size(); ++k) match_length[k] += o.match_length[k];
+    for (size_t k = 0; k < match_distance.size(); ++k) match_distance[k] += o.match_distance[k];
+    lazy_deferrals += o.lazy_deferrals;
+    searches += o.searches;
+    candidates += o.candidates;
+    cutoffs += o.cutoffs;
+    seconds += o.seconds;
+}
+
+// Counts the tokens of a compressed stream that produce the first `out_len` bytes.
+static void CountTokens(const std::vector<uint8_t>& comp, size_t out_len, LzssStats& st) {
+    size_t src = 0;
+    uint64_t pos = 0;
+    while (src < comp.size() && pos < out_len) {
+        const uint8_t flags = comp[src++];
+        for (int bit = 0; bit < 8 && src < comp.size() && pos < out_len; ++bit) {
+            if ((flags & (0x80 >> bit)) == 0) {
+                ++st.literals; ++src; ++pos;
+                continue;
+            }
+            if (src + 2 > comp.size()) return;
+            const uint8_t b1 = comp[src], b2 = comp[src + 1];
+            src += 2;
+            const int length = (b2 & 0x0F) + 3;
+            size_t dist = match_distance(pos, b1, b2);
+            int bucket = 0;
+            while ((dist >>= 1) != 0) ++bucket;
+            ++st.matches;
+            ++st.match_length[length - 3];
+            ++st.match_distance[bucket];
+            pos += length;
+        }
+    }
+}
+
+std::vector<uint8_t> DecompressLZSS_PSX(const std::vector<uint8_t>& data, size_t out_len_hint, LzssStats* stats) {
+    const auto t0 = stats ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    // Room for the fast path's over-copy and a final match running past the hint.
+    constexpr size_t SLACK = 8 * MAX_MATCH + MAX_MATCH;
+
+    LzssDecoder dec(out_len_hint);
+    std::vector<uint8_t> out(out_len_hint ? out_len_hint + SLACK : data.size() * 4 + SLACK);
+    size_t src = 0, pos = 0;
+    for (;;) {
+        auto p = dec.feed(data.data() + src, data.size() - src, out.data() + pos, out.size() - pos);
+        src += p.consumed;
+        pos += p.produced;
+        // Stopped with room left: out of input or at the hint.
+        if (pos < out.size()) break;
+        out.resize(out.size() * 2);
+    }
+    out.resize(pos);
+    if (stats) {
+        stats->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        stats->input_bytes += data.size();
+        stats->output_bytes += out.size();
+        CountTokens(data, out.size(), *stats);
+    }
     return out;
 }
 
@@ -110,80 +594,231 @@ std::vector<uint8_t> CompressLZSS_PSX(const std::vector<uint8_t>& data,
                                       int bucket_limit,
                                       int max_candidates,
                                       bool lazy_matching) {
-    const int n = (int)data.size();
-    if (n == 0) return {};
+    LzssParams params;
+    params.bucket_limit = bucket_limit;
+    params.max_candidates = max_candidates;
+    params.lazy_matching = lazy_matching;
+    return CompressLZSS_PSX(data, params);
+}
 
+// With a finder that counts (BasicMatchFinder<SearchStats>, ...), `counters`
+// receives its work counters.
+template <class Finder>
+static std::vector<uint8_t> CompressWith(const std::vector<uint8_t>& data, const LzssParams& params,
+                                         SearchStats* counters = nullptr) {
+    std::vector<uint8_t> buf(ZERO_PREFIX + data.size(), 0);
+    std::memcpy(buf.data() + ZERO_PREFIX, data.data(), data.size());
+    const int n = (int)buf.size();
     std::vector<uint8_t> out;
     out.reserve(data.size() / 2 + 64);
+    GroupWriter w(out);
+    Finder mf(buf.data(), n, params.bucket_limit, params.max_candidates);
 
-    auto start_group = [&](uint8_t& control, int& bits, size_t& control_pos) {
-        control = 0;
-        bits = 0;
-        out.push_back(0);
-        control_pos = out.size() - 1;
-    };
-    auto flush_group = [&](uint8_t control, size_t control_pos) {
-        out[control_pos] = control;
-    };
-
-    IndexMap index;
-    int ring_pos = RING_INIT;
-    int i = 0;
+    if (params.optimal_parse) {
+        auto [lens, backs] = longest_matches(mf, n);
+        auto lengths = optimal_lengths(lens, n);
+        for (int i = ZERO_PREFIX; i < n; ) {
+            int length = lengths[i];
+            if (length >= MIN_MATCH) {
+                w.match(ring_distance(i, backs[i]), length);
+                i += length;
+            } else {
+                w.literal(buf[i]);
+                ++i;
+            }
+        }
+    } else {
+        index_zero_prefix(mf);
+        parse_greedy(mf, w, params.lazy_matching, ZERO_PREFIX, n);
+    }
+    w.finish();
+    if constexpr (std::is_base_of_v<SearchStats, Finder>) {
+        if (counters) *counters = mf;
+    }
+    return out;
+}
 
-    uint8_t control = 0;
-    int bits = 0;
-    size_t control_pos = 0;
-    start_group(control, bits, control_pos);
+std::vector<uint8_t> CompressLZSS_PSX(const std::vector<uint8_t>& data, const LzssParams& params, LzssStats* stats) {
+    if (!stats) {
+        if (data.empty()) return {};
+        if (params.matcher == LzssMatcher::BinaryTree) return CompressWith<TreeMatchFinder>(data, params);
+        return CompressWith<MatchFinder>(data, params);
+    }
 
-    auto add_up_to = [&](int from, int count) {
-        int limit = std::min(from + count, n - (HASH_LEN - 1));
-        for (int j = from; j < limit; ++j) add_pos(index, data, n, j, bucket_limit);
-    };
+    const auto t0 = std::chrono::steady_clock::now();
+    std::vector<uint8_t> out;
+    SearchStats counters;
+    if (!data.empty()) {
+        out = params.matcher == LzssMatcher::BinaryTree
+                ? CompressWith<BasicTreeMatchFinder<SearchStats>>(data, params, &counters)
+                : CompressWith<BasicMatchFinder<SearchStats>>(data, params, &counters);
+    }
+    stats->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    stats->input_bytes += data.size();
+    stats->output_bytes += out.size();
+    stats->lazy_deferrals += counters.lazy_deferrals;
+    stats->searches += counters.searches;
+    stats->candidates += counters.candidates;
+    stats->cutoffs += counters.cutoffs;
+    CountTokens(out, data.size(), *stats);
+    return out;
+}
 
-    while (i < n) {
-        auto [best_len, best_back] = find_best(data, i, n, index, max_candidates);
-
-        if (lazy_matching && best_len == 3 && i + 1 < n) {
-            auto fb_next = find_best(data, i + 1, n, index, max_candidates);
-            if (fb_next.first >= 4) {
-                // Emit literal
-                out.push_back(data[i]);
-                ring_pos = (ring_pos + 1) & 0x0FFF;
-                if (i <= n - HASH_LEN) add_pos(index, data, n, i, bucket_limit);
-                bits += 1;
-                if (bits == 8) {
-                    flush_group(control, control_pos);
-                    if (i + 1 < n) start_group(control, bits, control_pos);
-                }
-                ++i;
-                continue;
+bool PadLZSS_PSX(std::vector<uint8_t>& comp, const std::vector<uint8_t>& raw, size_t size) {
+    struct Token { size_t pos; int off; int len; };   // len 1 = literal
+    std::vector<Token> tokens;
+    size_t src = 0, pos = 0, bytes = 0;
+    while (src < comp.size() && pos < raw.size()) {
+        const uint8_t flags = comp[src++];
+        for (int bit = 0; bit < 8 && src < comp.size() && pos < raw.size(); ++bit) {
+            if (flags & (0x80 >> bit)) {
+                if (src + 2 > comp.size()) return false;
+                const uint8_t b1 = comp[src], b2 = comp[src + 1];
+                tokens.push_back({ pos, ((b2 & 0xF0) << 4) | b1, (b2 & 0x0F) + 3 });
+                src += 2; bytes += 2; pos += (b2 & 0x0F) + 3;
+            } else {
+                tokens.push_back({ pos, 0, 1 });
+                ++src; ++bytes; ++pos;
             }
         }
+    }
+    if (pos != raw.size()) return false;
 
-        if (best_len >= MIN_MATCH) {
-            control |= (uint8_t)(0x80 >> bits);
-            int distance = (ring_pos - best_back) & 0x0FFF;
-            int length = best_len;
-            out.push_back((uint8_t)(distance & 0xFF));
-            out.push_back((uint8_t)(((distance >> 8) & 0x0F) << 4 | ((length - 3) & 0x0F)));
-            ring_pos = (ring_pos + length) & 0x0FFF;
-            add_up_to(i, length);
-            i += length;
-        } else {
-            out.push_back(data[i]);
-            ring_pos = (ring_pos + 1) & 0x0FFF;
-            if (i <= n - HASH_LEN) add_pos(index, data, n, i, bucket_limit);
-            ++i;
-        }
+    // size = token bytes + one flag byte per 8 tokens. Taking the first byte
+    // of a match as a literal adds one byte and one token; a length-3 match
+    // becomes three literals (one byte, two tokens). One more byte when the
+    // last group is full is left to the empty flag byte.
+    auto flag_bytes = [](size_t count) { return (count + 7) / 8; };
+    const size_t cur = bytes + flag_bytes(tokens.size());
+    if (size < cur) return false;
 
-        bits += 1;
-        if (bits == 8) {
-            flush_group(control, control_pos);
-            if (i < n) start_group(control, bits, control_pos);
+    std::vector<Token> grown, plan;
+    bool empty_group = false;
+    // Returns the number of peels made (at most max_peels) and leaves the
+    // result in `plan`; empty_group tells whether it reached `size` exactly.
+    auto grow = [&](size_t max_peels, bool& exact) {
+        size_t need = size - cur, t = tokens.size(), peels = 0;
+        auto stuck = [&]() { return need == 1 && t % 8 == 0; };
+        grown.clear();
+        for (Token tok : tokens) {
+            while (tok.len > MIN_MATCH && need > 0 && !stuck() && peels < max_peels) {
+                need -= 1 + (t % 8 == 0);
+                ++t; ++peels;
+                grown.push_back({ tok.pos, 0, 1 });
+                tok.pos += 1; tok.off = (tok.off + 1) & 0x0FFF; tok.len -= 1;
+            }
+            grown.push_back(tok);
+        }
+        plan.clear();
+        for (const Token& tok : grown) {
+            size_t delta = 1 + flag_bytes(t + 2) - flag_bytes(t);
+            if (tok.len == MIN_MATCH && delta <= need && !stuck()) {
+                need -= delta;
+                t += 2;
+                for (int k = 0; k < MIN_MATCH; ++k) plan.push_back({ tok.pos + k, 0, 1 });
+            } else {
+                plan.push_back(tok);
+            }
         }
+        empty_group = stuck();
+        exact = need == (empty_group ? 1u : 0u);
+        return peels;
+    };
+    // Converting only length-3 matches moves the token count in steps of two,
+    // so a byte it cannot reach is reached by leaving one peel undone.
+    bool exact = false;
+    size_t peels = grow(SIZE_MAX, exact);
+    if (!exact && peels > 0) grow(peels - 1, exact);
+    if (!exact) return false;
+
+    std::vector<uint8_t> out;
+    out.reserve(size);
+    GroupWriter w(out);
+    for (const Token& tok : plan) {
+        if (tok.len == 1) w.literal(raw[tok.pos]);
+        else w.match(tok.off, tok.len);
     }
-    if (bits != 0) {
-        out[control_pos] = control;
+    w.finish();
+    if (empty_group) out.push_back(0);
+    if (out.size() != size) return false;
+    comp = std::move(out);
+    return true;
+}
+
+// ===== Streaming encoder =====
+namespace {
+    // Bytes past a position that must be buffered before it can be parsed:
+    // parse_greedy's decisions reach MAX_MATCH + HASH_LEN - 1 bytes ahead, and
+    // the tree finder keys each inserted position (up to MAX_MATCH - 1 past the
+    // token start) on its next MAX_MATCH bytes.
+    constexpr int LOOKAHEAD   = 2 * MAX_MATCH + HASH_LEN;
+    // Dropped from the front of the buffer at a time; a multiple of WINDOW_SIZE
+    // so ring offsets and the match finder's slot indices stay the same.
+    constexpr int SLIDE       = 8 * WINDOW_SIZE;
+    constexpr int BUFFER_SIZE = WINDOW_SIZE + SLIDE + 2 * LOOKAHEAD;
+}
+
+struct LzssEncoder::State {
+    LzssParams params;
+    std::vector<uint8_t> buf;
+    std::vector<uint8_t> pending;   // GroupWriter output not handed out yet
+    GroupWriter w;
+    std::variant<MatchFinder, TreeMatchFinder> finder;
+    int pos = ZERO_PREFIX;          // next position to parse, relative to buf
+    bool primed = false;            // zero prefix indexed
+
+    // buf starts with the zero prefix already in place.
+    explicit State(const LzssParams& p)
+        : params(p), buf(BUFFER_SIZE, 0), w(pending),
+          finder(p.matcher == LzssMatcher::BinaryTree
+                     ? decltype(finder)(TreeMatchFinder(buf.data(), ZERO_PREFIX, p.bucket_limit, p.max_candidates))
+                     : decltype(finder)(MatchFinder(buf.data(), ZERO_PREFIX, p.bucket_limit, p.max_candidates))) {}
+
+    // Parses the tokens that start before `stop`.
+    template <class Finder>
+    void parse(Finder& mf, int stop) {
+        if (stop <= pos) return;
+        if (!primed) { index_zero_prefix(mf); primed = true; }
+        pos = parse_greedy(mf, w, params.lazy_matching, pos, stop);
     }
-    return out;
+};
+
+LzssEncoder::LzssEncoder(const LzssParams& params) {
+    if (params.optimal_parse)
+        throw std::runtime_error("O parse ótimo precisa da entrada inteira; use CompressLZSS_PSX.");
+    s_ = std::make_unique<State>(params);
+}
+
+LzssEncoder::~LzssEncoder() = default;
+LzssEncoder::LzssEncoder(LzssEncoder&&) noexcept = default;
+LzssEncoder& LzssEncoder::operator=(LzssEncoder&&) noexcept = default;
+
+void LzssEncoder::write(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    State& s = *s_;
+    std::visit([&](auto& mf) {
+        while (size > 0) {
+            int take = (int)std::min<size_t>(size, (size_t)(BUFFER_SIZE - mf.n));
+            std::memcpy(s.buf.data() + mf.n, data, take);
+            mf.n += take;
+            data += take; size -= take;
+
+            s.parse(mf, mf.n - LOOKAHEAD + 1);
+            if (s.pos >= WINDOW_SIZE + SLIDE) {
+                std::memmove(s.buf.data(), s.buf.data() + SLIDE, mf.n - SLIDE);
+                mf.slide(SLIDE);
+                s.pos -= SLIDE;
+            }
+        }
+    }, s.finder);
+    s.w.take_finished(out);
+}
+
+void LzssEncoder::finish(std::vector<uint8_t>& out) {
+    State& s = *s_;
+    std::visit([&](auto& mf) {
+        s.parse(mf, mf.n);
+    }, s.finder);
+    s.w.finish();
+    out.insert(out.end(), s.pending.begin(), s.pending.end());
+    s_ = std::make_unique<State>(s.params);
 }
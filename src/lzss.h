@@ -1,13 +1,127 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
+#include <array>
+#include <memory>
 #include <vector>
-#include <deque>
-#include <unordered_map>
 
 // PS1/Macross-compatible LZSS (ring 0xFEE) compressor/decompressor.
 
-std::vector<uint8_t> DecompressLZSS_PSX(const std::vector<uint8_t>& data, size_t out_len_hint = 0);
+// Bump whenever CompressLZSS_PSX can produce different output for the same
+// input and parameters; it is part of the compressed-block cache key.
+constexpr uint32_t LZSS_CODEC_VERSION = 2;
+
+// Optional counters filled by CompressLZSS_PSX / DecompressLZSS_PSX when a
+// pointer is passed; without one nothing is counted or timed. Token counts
+// and histograms describe the stream. The search counters come from the
+// compressor's match finder only (the tree counts the nodes it visits while
+// inserting, too). add() accumulates, e.g. over the blocks of a PUD.
+struct LzssStats {
+    uint64_t input_bytes = 0;
+    uint64_t output_bytes = 0;
+    uint64_t literals = 0;
+    uint64_t matches = 0;
+    std::array<uint64_t, 16> match_length{};    // [length - 3]
+    std::array<uint64_t, 13> match_distance{};  // [floor(log2(distance))]: 1, 2-3, ..., 2048-4095, 4096
+    uint64_t lazy_deferrals = 0;  // 3-byte matches left as a literal for a longer one at the next byte
+    uint64_t searches = 0;        // positions looked up
+    uint64_t candidates = 0;      // earlier positions compared
+    uint64_t cutoffs = 0;         // searches stopped by the candidate/depth limit
+    double seconds = 0;
+
+    void add(const LzssStats& o);
+};
+
+// Whole-buffer decode; wraps LzssDecoder. Stops at the end of `data` or, with
+// a hint, once at least out_len_hint bytes are out (the last match may run past it).
+std::vector<uint8_t> DecompressLZSS_PSX(const std::vector<uint8_t>& data, size_t out_len_hint = 0,
+                                        LzssStats* stats = nullptr);
+
+// Resumable decoder. feed() consumes as much of `in` as it can and writes to
+// `out`, stopping when either runs out; it can be suspended at any input or
+// output byte, including inside a match token or a match copy, and resumed by
+// the next feed(); feeding no input with more output room drains a copy cut
+// short. Output is the same however the stream is split.
+class LzssDecoder {
+public:
+    // out_limit works like DecompressLZSS_PSX's hint (0 = no limit).
+    explicit LzssDecoder(uint64_t out_limit = 0);
+
+    struct Progress {
+        size_t consumed = 0;
+        size_t produced = 0;
+    };
+    Progress feed(const uint8_t* in, size_t in_len, uint8_t* out, size_t out_cap);
+
+    // The limit was reached; further input is ignored.
+    bool finished() const;
+    uint64_t total_out() const { return total_; }
+    void reset();
+
+private:
+    std::array<uint8_t, 4096> ring_;   // last 4096 output bytes at their LZSS dictionary slots
+    uint64_t limit_;
+    uint64_t total_ = 0;
+    uint8_t flags_ = 0;
+    int bit_ = 8;                      // next flag bit; 8 = a new flag byte is due
+    bool have_b1_ = false;             // first byte of a match token already read
+    uint8_t b1_ = 0;
+    size_t match_dist_ = 0;            // match copy cut short by a full output buffer
+    size_t match_left_ = 0;
+};
+
+// Match search engine. HashChain walks the newest positions with the same
+// 3-byte hash and compares at most min(bucket_limit, max_candidates) real
+// candidates. BinaryTree keeps the window in per-hash search trees and always
+// finds the longest match at its nearest distance; max_candidates only caps
+// the tree depth and bucket_limit is unused.
+enum class LzssMatcher { HashChain, BinaryTree };
+
+// Compression profile. The front ends map their presets onto this:
+//   rapido      64 / 128
+//   equilibrado 128 / 256  (default)
+//   maximo      256 / 1024
+//   otimo       256 / 1024, BinaryTree + optimal_parse
+struct LzssParams {
+    int bucket_limit = 128;
+    int max_candidates = 256;
+    LzssMatcher matcher = LzssMatcher::HashChain;
+    bool lazy_matching = true;
+    // Shortest-path parse over all matches instead of greedy/lazy; lazy_matching is ignored.
+    bool optimal_parse = false;
+};
+
 std::vector<uint8_t> CompressLZSS_PSX(const std::vector<uint8_t>& data,
                                       int bucket_limit = 128,
                                       int max_candidates = 256,
                                       bool lazy_matching = true);
+std::vector<uint8_t> CompressLZSS_PSX(const std::vector<uint8_t>& data, const LzssParams& params,
+                                      LzssStats* stats = nullptr);
+
+// Re-encodes `comp`, a stream that decodes to `raw`, into exactly `size`
+// bytes that decode to the same data: matches give up bytes as literals and,
+// when only one more byte is needed after a full flag group, the stream ends
+// with an empty flag byte (it decodes to nothing). Returns false and leaves
+// `comp` alone if `size` is below its size or beyond what it can grow to.
+bool PadLZSS_PSX(std::vector<uint8_t>& comp, const std::vector<uint8_t>& raw, size_t size);
+
+// Streaming compressor with fixed memory: the 4 KB window plus a short
+// lookahead (about 40 KB in all). Output is byte-identical to
+// CompressLZSS_PSX with the same params; optimal_parse is not supported (the
+// parse needs the whole input) and throws. write() appends the flag groups
+// completed so far; finish() flushes the rest and readies the encoder for a
+// new stream.
+class LzssEncoder {
+public:
+    explicit LzssEncoder(const LzssParams& params = LzssParams());
+    ~LzssEncoder();
+    LzssEncoder(LzssEncoder&&) noexcept;
+    LzssEncoder& operator=(LzssEncoder&&) noexcept;
+
+    void write(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+    void finish(std::vector<uint8_t>& out);
+
+private:
+    struct State;
+    std::unique_ptr<State> s_;
+};
@@ -0,0 +1,93 @@
+#include "lzss_auto.h"
+#include "lzss_cache.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <stdexcept>
+
+std::vector<LzssAutoProfile> LzssAutoProfiles(bool lazy_matching) {
+    std::vector<LzssAutoProfile> v;
+    auto add = [&](const char* name, int bl, int mc, LzssMatcher m, bool optimal) {
+        LzssParams p;
+        p.bucket_limit = bl; p.max_candidates = mc; p.matcher = m;
+        p.lazy_matching = lazy_matching; p.optimal_parse = optimal;
+        v.push_back({ name, p });
+    };
+    add("rapido",      64,  128,  LzssMatcher::HashChain,  false);
+    add("equilibrado", 128, 256,  LzssMatcher::HashChain,  false);
+    add("maximo",      256, 1024, LzssMatcher::HashChain,  false);
+    add("otimo",       256, 1024, LzssMatcher::BinaryTree, true);
+    return v;
+}
+
+std::vector<LzssAutoResult> CompressLZSS_Auto(const std::vector<std::vector<uint8_t>>& blocks,
+                                              const LzssAutoOptions& options,
+                                              unsigned threads,
+                                              LzssBlockCache* cache) {
+    const size_t nb = blocks.size(), np = options.profiles.size();
+    if (np == 0) throw std::runtime_error("Nenhum perfil de compressão para o modo automático.");
+
+    // First profile (per block) known to reach the target; INT_MAX = none yet.
+    std::vector<std::atomic<int>> reached(nb);
+    for (auto& r : reached) r.store(INT_MAX, std::memory_order_relaxed);
+    std::vector<std::vector<std::vector<uint8_t>>> outs(nb, std::vector<std::vector<uint8_t>>(np));
+
+    // Job t = profile t / nb for block t % nb: every block's cheap profiles come first.
+    ParallelFor(nb * np, threads, [&](size_t t) {
+        const size_t b = t % nb;
+        const int p = (int)(t / nb);
+        if (p > reached[b].load(std::memory_order_acquire)) return;
+        const auto& params = options.profiles[p].params;
+        auto comp = cache ? cache->compress(blocks[b], params) : CompressLZSS_PSX(blocks[b], params);
+        if (options.target_ratio > 0 && comp.size() <= options.target_ratio * blocks[b].size()) {
+            int cur = reached[b].load(std::memory_order_relaxed);
+            while (p < cur && !reached[b].compare_exchange_weak(cur, p, std::memory_order_acq_rel)) {}
+        }
+        outs[b][p] = std::move(comp);
+    });
+
+    // Every profile up to the first one reaching the target ran (a skip needs
+    // an earlier one reaching it), so the choice is the same for any schedule.
+    std::vector<LzssAutoResult> results(nb);
+    for (size_t b = 0; b < nb; ++b) {
+        const int last = std::min<int>((int)np - 1, reached[b].load());
+        auto& r = results[b];
+        r.tried = last + 1;
+        r.winner = 0;
+        for (int p = 1; p <= last; ++p)
+            if (outs[b][p].size() < outs[b][r.winner].size()) r.winner = p;
+        r.data = std::move(outs[b][r.winner]);
+    }
+    return results;
+}
+
+std::vector<LzssBudgetResult> CompressLZSS_Budget(const std::vector<std::vector<uint8_t>>& blocks,
+                                                  const std::vector<size_t>& budgets,
+                                                  const std::vector<LzssAutoProfile>& profiles,
+                                                  unsigned threads,
+                                                  LzssBlockCache* cache) {
+    if (budgets.size() != blocks.size())
+        throw std::runtime_error("Número de orçamentos não bate com o número de blocos.");
+    if (profiles.empty()) throw std::runtime_error("Nenhum perfil de compressão para o modo orçamento.");
+
+    std::vector<LzssBudgetResult> results(blocks.size());
+    ParallelFor(blocks.size(), threads, [&](size_t b) {
+        auto& r = results[b];
+        r.budget = budgets[b];
+        for (int p = 0; p < (int)profiles.size(); ++p) {
+            const auto& params = profiles[p].params;
+            auto comp = cache ? cache->compress(blocks[b], params) : CompressLZSS_PSX(blocks[b], params);
+            r.tried = p + 1;
+            if (r.profile < 0 || comp.size() < r.data.size()) {
+                r.data = std::move(comp);
+                r.profile = p;
+            }
+            if (r.data.size() <= r.budget) {
+                r.fits = true;
+                break;
+            }
+        }
+    });
+    return results;
+}
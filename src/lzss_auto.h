@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "lzss.h"
+
+class LzssBlockCache;
+
+// Automatic per-block profile choice ("auto"): every block is compressed
+// with several profiles and the smallest output is kept.
+
+struct LzssAutoProfile {
+    std::string name;
+    LzssParams params;
+};
+
+// The front ends' presets, cheapest first: rapido, equilibrado, maximo, otimo.
+std::vector<LzssAutoProfile> LzssAutoProfiles(bool lazy_matching = true);
+
+struct LzssAutoOptions {
+    std::vector<LzssAutoProfile> profiles = LzssAutoProfiles();   // cheapest first
+    // Compressed/raw ratio that is good enough: profiles after the first one
+    // reaching it are not needed. 0 = always try every profile.
+    double target_ratio = 0.0;
+};
+
+struct LzssAutoResult {
+    std::vector<uint8_t> data;
+    int winner = -1;   // index into LzssAutoOptions::profiles
+    int tried = 0;     // profiles the winner was chosen from
+};
+
+// Compresses every block with each profile as separate jobs on `threads`
+// workers (0 = all cores), cheap profiles for all blocks first. A block's
+// winner is the smallest output among its profiles up to the first one that
+// reaches target_ratio; ties go to the cheaper profile. Later profiles are
+// skipped once that is known, and their results dropped if they were already
+// running, so the output does not depend on the thread count. A `cache` is
+// consulted for every job.
+std::vector<LzssAutoResult> CompressLZSS_Auto(const std::vector<std::vector<uint8_t>>& blocks,
+                                              const LzssAutoOptions& options = LzssAutoOptions(),
+                                              unsigned threads = 0,
+                                              LzssBlockCache* cache = nullptr);
+
+// Size budget: the cheapest profile whose output fits.
+struct LzssBudgetResult {
+    std::vector<uint8_t> data;
+    size_t budget = 0;
+    int profile = -1;    // first profile that fit; otherwise the smallest output's
+    int tried = 0;
+    bool fits = false;
+};
+
+// Compresses block i with each profile in turn, cheapest first, and stops at
+// the first output of at most budgets[i] bytes; if none fits, the smallest
+// output is kept. Blocks run in parallel on `threads` workers (0 = all cores).
+std::vector<LzssBudgetResult> CompressLZSS_Budget(const std::vector<std::vector<uint8_t>>& blocks,
+                                                  const std::vector<size_t>& budgets,
+                                                  const std::vector<LzssAutoProfile>& profiles = LzssAutoProfiles(),
+                                                  unsigned threads = 0,
+                                                  LzssBlockCache* cache = nullptr);
@@ -0,0 +1,422 @@
+// Codec micro-benchmark: runs CompressLZSS_PSX / DecompressLZSS_PSX over a
+// reproducible synthetic corpus shaped like our PS1 assets and reports MB/s,
+// ratio and heap allocations per call for every profile and match finder,
+// plus candidates/s of the match-length kernel against the scalar loop.
+// "lzss_bench io" compares the fileio helpers with the ifstream ones they replaced.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+#include "lzss.h"
+#include "lzss_match.h"
+
+// ===== Allocation counter =====
+// GCC inlines a replacement delete into its callers and then reports the free()
+// as mismatched with operator new (-Wmismatched-new-delete); keeping the deletes
+// out of line hides the malloc/free pair, and the sized form just forwards.
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+static std::atomic<uint64_t> g_allocs{0};
+
+void* operator new(size_t sz) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(sz ? sz : 1)) return p;
+    throw std::bad_alloc();
+}
+BENCH_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void* p, size_t) noexcept { ::operator delete(p); }
+
+// ===== Synthetic corpus =====
+// Only raw mt19937 output is used (never <random> distributions), so the corpus
+// is byte-identical across compilers and platforms.
+struct CorpusItem {
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+static std::vector<uint8_t> MakeTexture4bpp(std::mt19937& rng, size_t size) {
+    // 256-pixel-wide sprite sheet: transparent (0) borders, sprites built from
+    // repeated nibble patterns with a few colours.
+    std::vector<uint8_t> b(size, 0);
+    const size_t row = 128;
+    for (size_t y = 0; y * row < size; ++y) {
+        if (rng() % 4 == 0) continue;                 // fully transparent row
+        size_t x0 = rng() % 48, x1 = x0 + 16 + rng() % 64;
+        uint8_t a = (uint8_t)(rng() % 16), c = (uint8_t)(rng() % 16);
+        for (size_t x = x0; x < x1 && x < row && y * row + x < size; ++x) {
+            uint8_t lo = (rng() % 8) ? a : (uint8_t)(rng() % 16);
+            uint8_t hi = (rng() % 8) ? c : (uint8_t)(rng() % 16);
+            b[y * row + x] = (uint8_t)(hi << 4 | lo);
+        }
+    }
+    return b;
+}
+
+static std::vector<uint8_t> MakeTexture8bpp(std::mt19937& rng, size_t size) {
+    // Paletted background: horizontal gradients with dithering and zero gaps.
+    std::vector<uint8_t> b(size, 0);
+    const size_t row = 256;
+    for (size_t y = 0; y * row < size; ++y) {
+        uint8_t base = (uint8_t)(rng() % 200);
+        size_t gap = rng() % 3 == 0 ? rng() % row : row;
+        for (size_t x = 0; x < gap && y * row + x < size; ++x)
+            b[y * row + x] = (uint8_t)(base + x / 32 + (rng() % 4 == 0));
+    }
+    return b;
+}
+
+static std::vector<uint8_t> MakeAdpcm(std::mt19937& rng, size_t size) {
+    // SPU ADPCM: 16-byte frames of shift/filter, flags and 14 bytes of noisy nibbles.
+    std::vector<uint8_t> b(size, 0);
+    for (size_t f = 0; f + 16 <= size; f += 16) {
+        b[f] = (uint8_t)((rng() % 5) << 4 | (rng() % 13));
+        b[f + 1] = (f + 16 == size) ? 1 : (rng() % 64 == 0 ? 2 : 0);
+        bool silent = rng() % 16 == 0;
+        for (int k = 2; k < 16; ++k) b[f + k] = silent ? 0 : (uint8_t)rng();
+    }
+    return b;
+}
+
+static std::vector<uint8_t> MakeMipsCode(std::mt19937& rng, size_t size) {
+    // R3000 instruction words (little-endian) drawn from a few common forms.
+    std::vector<uint8_t> b;
+    b.reserve(size);
+    auto reg = [&]() { return (uint32_t)(rng() % 32); };
+    while (b.size() + 4 <= size) {
+        uint32_t w;
+        switch (rng() % 8) {
+        case 0: w = 0x0F000000u | (reg() << 16) | (rng() % 0x40) << 8; break;        // lui
+        case 1: w = 0x24000000u | (reg() << 21) | (reg() << 16) | (rng() % 256); break; // addiu
+        case 2: w = 0x8C000000u | (29u << 21) | (reg() << 16) | ((rng() % 16) * 4); break; // lw sp
+        case 3: w = 0xAC000000u | (29u << 21) | (reg() << 16) | ((rng() % 16) * 4); break; // sw sp
+        case 4: w = 0x0C000000u | (0x10000u + (rng() % 0x800) * 4) >> 2; break;        // jal
+        case 5: w = 0x00000021u | (reg() << 21) | (reg() << 16) | (reg() << 11); break; // addu
+        case 6: w = 0x03E00008u; break;                                                 // jr ra
+        default: w = 0; break;                                                          // nop
+        }
+        for (int k = 0; k < 4; ++k) b.push_back((uint8_t)(w >> (8 * k)));
+    }
+    b.resize(size, 0);
+    return b;
+}
+
+static std::vector<uint8_t> MakeTextTable(std::mt19937& rng, size_t size) {
+    // Pointer table followed by zero-terminated strings from a small vocabulary.
+    static const char* words[] = { "Hikaru", "Minmay", "Misa", "Roy", "Valkyrie", "Macross",
+        "Zentradi", "Fighter", "GERWALK", "Battroid", "missile", "attack", "return",
+        "to", "the", "ship", "!", "?", " ", " ", "\n" };
+    const size_t n_strings = size / 48;
+    std::vector<uint8_t> b(n_strings * 4, 0);
+    for (size_t s = 0; s < n_strings && b.size() < size; ++s) {
+        uint32_t ptr = (uint32_t)b.size();
+        std::memcpy(&b[s * 4], &ptr, 4);
+        int n_words = 2 + (int)(rng() % 8);
+        for (int w = 0; w < n_words; ++w) {
+            const char* t = words[rng() % (sizeof(words) / sizeof(words[0]))];
+            b.insert(b.end(), t, t + std::strlen(t));
+        }
+        b.push_back(0);
+    }
+    b.resize(size, 0);
+    return b;
+}
+
+static std::vector<CorpusItem> MakeCorpus(size_t block_size) {
+    std::mt19937 rng(0x4D414352u); // "MACR"
+    std::vector<CorpusItem> c;
+    c.push_back({ "tex4bpp", MakeTexture4bpp(rng, block_size) });
+    c.push_back({ "tex8bpp", MakeTexture8bpp(rng, block_size) });
+    c.push_back({ "adpcm",   MakeAdpcm(rng, block_size) });
+    c.push_back({ "mips",    MakeMipsCode(rng, block_size) });
+    c.push_back({ "text",    MakeTextTable(rng, block_size) });
+    return c;
+}
+
+// ===== Runner =====
+struct Profile {
+    const char* name;
+    LzssParams params;
+};
+
+static std::vector<Profile> Profiles() {
+    std::vector<Profile> v;
+    const LzssMatcher HASH = LzssMatcher::HashChain, TREE = LzssMatcher::BinaryTree;
+    auto add = [&](const char* name, int bl, int mc, LzssMatcher m, bool lazy, bool optimal) {
+        LzssParams p;
+        p.bucket_limit = bl; p.max_candidates = mc; p.matcher = m;
+        p.lazy_matching = lazy; p.optimal_parse = optimal;
+        v.push_back({ name, p });
+    };
+    add("rapido",      64,  128,  HASH, true,  false);
+    add("rapido",      64,  128,  HASH, false, false);
+    add("equilibrado", 128, 256,  HASH, true,  false);
+    add("equilibrado", 128, 256,  HASH, false, false);
+    // otimo ships with the tree, maximo with hash chains; both engines are measured for each.
+    add("maximo",      256, 1024, HASH, true,  false);
+    add("maximo",      256, 1024, HASH, false, false);
+    add("maximo",      256, 1024, TREE, true,  false);
+    add("maximo",      256, 1024, TREE, false, false);
+    add("otimo",       256, 1024, HASH, true,  true);
+    add("otimo",       256, 1024, TREE, true,  true);
+    return v;
+}
+
+static const char* MatcherName(LzssMatcher m) {
+    return m == LzssMatcher::BinaryTree ? "arvore" : "hash";
+}
+
+struct Result {
+    std::string corpus, profile;
+    LzssMatcher matcher;
+    bool lazy, optimal;
+    size_t in_size, out_size;
+    double comp_mbs, decomp_mbs;
+    double comp_allocs, decomp_allocs;
+    bool roundtrip;
+};
+
+template <class Fn>
+static double TimeIters(int iters, Fn&& fn) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iters; ++i) fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// ===== Match-length kernel =====
+// Replays the comparisons the hash-chain finder makes: for every position, up
+// to 16 earlier positions in the window that share its first three bytes.
+struct KernelResult {
+    std::string corpus;
+    size_t candidates;
+    double scalar_cps, kernel_cps;
+    bool same;
+};
+
+static KernelResult BenchMatchKernel(const CorpusItem& item, int iters) {
+    const uint8_t* b = item.data.data();
+    const int n = (int)item.data.size();
+    std::vector<int> head(1 << 16, -1), prev(n, -1);
+    std::vector<int> cand_pos, cand_cur;
+    for (int i = 0; i + 3 <= n; ++i) {
+        uint32_t key = ((uint32_t)b[i] << 8 ^ (uint32_t)b[i + 1] << 4 ^ b[i + 2]) & 0xFFFF;
+        int taken = 0;
+        for (int p = head[key]; p >= 0 && i - p <= 4096 && taken < 16; p = prev[p]) {
+            if (b[p] != b[i] || b[p + 1] != b[i + 1] || b[p + 2] != b[i + 2]) continue;
+            cand_pos.push_back(p);
+            cand_cur.push_back(i);
+            ++taken;
+        }
+        prev[i] = head[key];
+        head[key] = i;
+    }
+
+    KernelResult r{ item.name, cand_pos.size(), 0, 0, true };
+    if (cand_pos.empty()) return r;
+    uint64_t sum_scalar = 0, sum_kernel = 0;
+    double ts = TimeIters(iters, [&]() {
+        for (size_t k = 0; k < cand_pos.size(); ++k) {
+            int i = cand_cur[k], max_len = std::min(18, n - i);
+            sum_scalar += MatchLengthScalar(b + cand_pos[k], b + i, 3, max_len);
+        }
+    });
+    double tk = TimeIters(iters, [&]() {
+        for (size_t k = 0; k < cand_pos.size(); ++k) {
+            int i = cand_cur[k], max_len = std::min(18, n - i);
+            sum_kernel += MatchLength(b + cand_pos[k], b + i, 3, max_len, n - i);
+        }
+    });
+    const double total = (double)cand_pos.size() * iters;
+    r.scalar_cps = total / ts;
+    r.kernel_cps = total / tk;
+    r.same = sum_scalar == sum_kernel;
+    return r;
+}
+
+static const char* KernelName() {
+#ifdef LZSS_MATCH_SSE2
+    return "sse2";
+#else
+    return "escalar";
+#endif
+}
+
+// ===== File I/O =====
+// The ifstream helpers main.cpp, gko.cpp and lzss_cli.cpp used before fileio.
+static std::vector<uint8_t> LegacyReadAllBytes(const std::filesystem::path& p) {
+    std::ifstream f(p, std::ios::binary);
+    if (!f) throw std::runtime_error("Falha ao abrir: " + p.string());
+    f.seekg(0, std::ios::end);
+    size_t sz = (size_t)f.tellg();
+    f.seekg(0, std::ios::beg);
+    std::vector<uint8_t> buf(sz);
+    f.read((char*)buf.data(), sz);
+    return buf;
+}
+static void LegacyWriteAllBytes(const std::filesystem::path& p, const std::vector<uint8_t>& bytes) {
+    std::ofstream f(p, std::ios::binary);
+    if (!f) throw std::runtime_error("Falha ao salvar: " + p.string());
+    f.write((const char*)bytes.data(), bytes.size());
+}
+
+// Whole-file reads and writes of one `mb` MB file in the temp directory.
+// Reads run with a warm page cache. The "fileio" write is the plain atomic
+// rename, comparable with the ofstream write; the "durável" one also flushes
+// to disk before the rename, as repacked archives do.
+static int RunIoBench(size_t mb, int iters) {
+    const auto path = std::filesystem::temp_directory_path() / "lzss_bench_io.bin";
+    std::vector<uint8_t> data(mb << 20);
+    std::mt19937 rng(0x4D414352u);
+    for (auto& b : data) b = (uint8_t)rng();
+
+    bool same = true;
+    std::vector<uint8_t> back;
+    try {
+        const double total = (double)data.size() * iters / 1e6;
+        double lw = TimeIters(iters, [&]() { LegacyWriteAllBytes(path, data); });
+        double lr = TimeIters(iters, [&]() { back = LegacyReadAllBytes(path); });
+        same = same && back == data;
+        double nw = TimeIters(iters, [&]() { WriteAllBytes(path, data); });
+        double nr = TimeIters(iters, [&]() { back = ReadAllBytes(path); });
+        same = same && back == data;
+        double dw = TimeIters(iters, [&]() { WriteAllBytes(path, data, true); });
+        back = ReadAllBytes(path);
+        same = same && back == data;
+        std::printf("Arquivo de %zu MB, %d vezes (%s)\n%-10s %12s %12s %12s\n", mb, iters, path.string().c_str(),
+                    "", "ifstream", "fileio", "durável");
+        std::printf("%-10s %9.1f MB/s %7.1f MB/s\n", "leitura", total / lr, total / nr);
+        std::printf("%-10s %9.1f MB/s %7.1f MB/s %7.1f MB/s\n", "escrita", total / lw, total / nw, total / dw);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        same = false;
+    }
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    if (!same) std::printf("** LEITURA DIFERENTE DO ARQUIVO GRAVADO **\n");
+    return same ? 0 : 4;
+}
+
+static void PrintUsage() {
+    std::printf("MACROSS LZSS benchmark\n"
+                "Uso: lzss_bench [-o resultados.json] [--iters N] [--block-kb N]\n"
+                "     lzss_bench io [--iters N] [--mb N]\n"
+                "Padrões: -o lzss_bench.json, --iters 5, --block-kb 64, --mb 64\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "io") {
+        int iters = 5;
+        size_t mb = 64;
+        for (int i = 2; i < argc; ++i) {
+            std::string a = argv[i];
+            if (a == "--iters" && i + 1 < argc) iters = std::max(1, std::atoi(argv[++i]));
+            else if (a == "--mb" && i + 1 < argc) mb = (size_t)std::max(1, std::atoi(argv[++i]));
+            else { PrintUsage(); return a == "-h" || a == "--help" ? 0 : 1; }
+        }
+        return RunIoBench(mb, iters);
+    }
+
+    std::string json_path = "lzss_bench.json";
+    int iters = 5;
+    size_t block_kb = 64;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if ((a == "-o" || a == "--out") && i + 1 < argc) json_path = argv[++i];
+        else if (a == "--iters" && i + 1 < argc) iters = std::max(1, std::atoi(argv[++i]));
+        else if (a == "--block-kb" && i + 1 < argc) block_kb = (size_t)std::max(1, std::atoi(argv[++i]));
+        else { PrintUsage(); return a == "-h" || a == "--help" ? 0 : 1; }
+    }
+
+    auto corpus = MakeCorpus(block_kb * 1024);
+    std::vector<Result> results;
+
+    std::printf("%-8s %-12s %-6s %-5s %9s %8s %10s %10s %8s %8s\n",
+                "corpus", "perfil", "busca", "lazy", "saida", "ratio", "comp MB/s", "desc MB/s", "aloc/c", "aloc/d");
+    for (const auto& item : corpus) {
+        for (const auto& prof : Profiles()) {
+            Result r{ item.name, prof.name, prof.params.matcher, prof.params.lazy_matching, prof.params.optimal_parse,
+                      item.data.size(), 0, 0, 0, 0, 0, false };
+            std::vector<uint8_t> comp, raw;
+
+            uint64_t a0 = g_allocs.load();
+            double tc = TimeIters(iters, [&]() { comp = CompressLZSS_PSX(item.data, prof.params); });
+            uint64_t a1 = g_allocs.load();
+            double td = TimeIters(iters, [&]() { raw = DecompressLZSS_PSX(comp, item.data.size()); });
+            uint64_t a2 = g_allocs.load();
+
+            const double mb = (double)item.data.size() * iters / 1e6;
+            r.out_size = comp.size();
+            r.comp_mbs = mb / tc;
+            r.decomp_mbs = mb / td;
+            r.comp_allocs = (double)(a1 - a0) / iters;
+            r.decomp_allocs = (double)(a2 - a1) / iters;
+            r.roundtrip = raw == item.data;
+            results.push_back(r);
+
+            std::printf("%-8s %-12s %-6s %-5s %9zu %7.2f%% %10.1f %10.1f %8.1f %8.1f%s\n",
+                        r.corpus.c_str(), r.profile.c_str(), MatcherName(r.matcher), r.optimal ? "-" : (r.lazy ? "sim" : "nao"),
+                        r.out_size, 100.0 * r.out_size / r.in_size, r.comp_mbs, r.decomp_mbs,
+                        r.comp_allocs, r.decomp_allocs, r.roundtrip ? "" : "  ** ROUNDTRIP FALHOU **");
+        }
+    }
+
+    std::vector<KernelResult> kernels;
+    std::printf("\nComprimento de match (kernel %s), candidatos/s:\n%-8s %10s %14s %14s %8s\n",
+                KernelName(), "corpus", "candidatos", "escalar", "kernel", "ganho");
+    for (const auto& item : corpus) {
+        KernelResult k = BenchMatchKernel(item, iters * 4);
+        kernels.push_back(k);
+        std::printf("%-8s %10zu %14.0f %14.0f %7.2fx%s\n", k.corpus.c_str(), k.candidates,
+                    k.scalar_cps, k.kernel_cps, k.scalar_cps > 0 ? k.kernel_cps / k.scalar_cps : 0.0,
+                    k.same ? "" : "  ** RESULTADO DIFERENTE **");
+    }
+
+    std::ofstream js(json_path);
+    if (!js) { std::fprintf(stderr, "Erro ao salvar: %s\n", json_path.c_str()); return 3; }
+    js << "{\n  \"block_size\": " << block_kb * 1024 << ",\n  \"iters\": " << iters << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        char line[512];
+        std::snprintf(line, sizeof(line),
+            "    {\"corpus\": \"%s\", \"profile\": \"%s\", \"matcher\": \"%s\", \"lazy\": %s, \"optimal\": %s, "
+            "\"in_size\": %zu, \"out_size\": %zu, \"ratio\": %.4f, \"compress_mbs\": %.2f, "
+            "\"decompress_mbs\": %.2f, \"compress_allocs\": %.1f, \"decompress_allocs\": %.1f, "
+            "\"roundtrip\": %s}%s\n",
+            r.corpus.c_str(), r.profile.c_str(), MatcherName(r.matcher), r.lazy ? "true" : "false", r.optimal ? "true" : "false",
+            r.in_size, r.out_size, (double)r.out_size / r.in_size, r.comp_mbs, r.decomp_mbs,
+            r.comp_allocs, r.decomp_allocs, r.roundtrip ? "true" : "false",
+            i + 1 < results.size() ? "," : "");
+        js << line;
+    }
+    js << "  ],\n  \"match_kernel\": \"" << KernelName() << "\",\n  \"match_kernel_results\": [\n";
+    for (size_t i = 0; i < kernels.size(); ++i) {
+        const auto& k = kernels[i];
+        char line[256];
+        std::snprintf(line, sizeof(line),
+            "    {\"corpus\": \"%s\", \"candidates\": %zu, \"scalar_cps\": %.0f, \"kernel_cps\": %.0f, "
+            "\"same\": %s}%s\n",
+            k.corpus.c_str(), k.candidates, k.scalar_cps, k.kernel_cps, k.same ? "true" : "false",
+            i + 1 < kernels.size() ? "," : "");
+        js << line;
+    }
+    js << "  ]\n}\n";
+    std::printf("\nResultados salvos em %s\n", json_path.c_str());
+
+    for (const auto& r : results) if (!r.roundtrip) return 4;
+    for (const auto& k : kernels) if (!k.same) return 4;
+    return 0;
+}
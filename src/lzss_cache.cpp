@@ -0,0 +1,172 @@
+#include "lzss_cache.h"
+#include "fileio.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+
+static const char CACHE_EXT[] = ".lzc";
+static const uint8_t CACHE_MAGIC[4] = { 'L', 'Z', 'C', '1' };
+
+static inline uint64_t Rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// 128-bit key: two independently mixed 64-bit lanes over the raw bytes,
+// seeded with the parameters and codec version.
+static std::string CacheKey(const std::vector<uint8_t>& raw, const LzssParams& p) {
+    const uint64_t K1 = 0x9E3779B97F4A7C15ull, K2 = 0xC2B2AE3D27D4EB4Full;
+    uint64_t seed = ((uint64_t)LZSS_CODEC_VERSION << 48) ^ ((uint64_t)(uint32_t)p.bucket_limit << 24)
+                  ^ (uint64_t)(uint32_t)p.max_candidates ^ ((uint64_t)p.lazy_matching << 62)
+                  ^ ((uint64_t)p.optimal_parse << 63) ^ ((uint64_t)p.matcher << 56);
+    uint64_t h1 = seed ^ ((uint64_t)raw.size() * K1);
+    uint64_t h2 = ~seed ^ ((uint64_t)raw.size() * K2);
+    const uint8_t* b = raw.data();
+    size_t n = raw.size(), i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w; std::memcpy(&w, b + i, 8);
+        h1 = Rotl64(h1 ^ (w * K2), 31) * K1;
+        h2 = Rotl64(h2 + w, 27) * K2 ^ h1;
+    }
+    uint64_t w = 0;
+    if (i < n) std::memcpy(&w, b + i, n - i);
+    h1 = Rotl64(h1 ^ (w * K2), 31) * K1;
+    h2 = Rotl64(h2 + w, 27) * K2 ^ h1;
+    h1 ^= h1 >> 33; h1 *= K2; h1 ^= h1 >> 29;
+    h2 ^= h2 >> 33; h2 *= K1; h2 ^= h2 >> 29;
+
+    static const char hex[] = "0123456789abcdef";
+    std::string key(32, '0');
+    for (int k = 0; k < 16; ++k) {
+        key[15 - k] = hex[(h1 >> (4 * k)) & 0xF];
+        key[31 - k] = hex[(h2 >> (4 * k)) & 0xF];
+    }
+    return key;
+}
+
+LzssBlockCache::LzssBlockCache(const std::filesystem::path& dir, uint64_t max_bytes)
+    : dir_(dir), max_bytes_(max_bytes) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    for (auto it = std::filesystem::directory_iterator(dir_, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        const auto& p = it->path();
+        if (p.extension() != CACHE_EXT || !it->is_regular_file()) continue;
+        Item item{ it->file_size(), it->last_write_time() };
+        items_.emplace(p.stem().string(), item);
+        total_ += item.size;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    trim_locked();
+}
+
+std::filesystem::path LzssBlockCache::path_of(const std::string& key) const {
+    return dir_ / (key + CACHE_EXT);
+}
+
+std::vector<uint8_t> LzssBlockCache::compress(const std::vector<uint8_t>& raw, const LzssParams& params,
+                                              LzssStats* lzss_stats) {
+    std::string key = CacheKey(raw, params);
+    bool known;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        known = items_.count(key) != 0;
+    }
+    if (known) {
+        try {
+            auto t0 = std::chrono::steady_clock::now();
+            std::vector<uint8_t> file = ReadAllBytes(path_of(key));
+            if (file.size() >= 8 && std::memcmp(file.data(), CACHE_MAGIC, 4) == 0) {
+                std::vector<uint8_t> comp(file.begin() + 8, file.end());
+                LzssStats hit;
+                if (DecompressLZSS_PSX(comp, raw.size(), lzss_stats ? &hit : nullptr) == raw) {
+                    if (lzss_stats) {
+                        std::swap(hit.input_bytes, hit.output_bytes);   // counted as a decode
+                        hit.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                        lzss_stats->add(hit);
+                    }
+                    auto now = std::filesystem::file_time_type::clock::now();
+                    std::error_code ec;
+                    std::filesystem::last_write_time(path_of(key), now, ec);
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    auto it = items_.find(key);
+                    if (it != items_.end()) it->second.last_use = now;
+                    ++stats_.hits;
+                    return comp;
+                }
+            }
+        } catch (const std::exception&) {
+            // Evicted by another process or unreadable: fall through and rebuild it.
+        }
+    }
+
+    std::vector<uint8_t> comp = CompressLZSS_PSX(raw, params, lzss_stats);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.misses;
+        if (!pending_.insert(key).second) return comp;   // another thread is storing it
+    }
+    try {
+        store(key, raw, comp);
+    } catch (const std::exception&) {
+        // A cache that cannot be written only costs speed.
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.erase(key);
+    return comp;
+}
+
+void LzssBlockCache::store(const std::string& key, const std::vector<uint8_t>& raw, const std::vector<uint8_t>& comp) {
+    std::vector<uint8_t> file(8 + comp.size());
+    std::memcpy(file.data(), CACHE_MAGIC, 4);
+    uint32_t n = (uint32_t)raw.size();
+    for (int k = 0; k < 4; ++k) file[4 + k] = (uint8_t)(n >> (8 * k));
+    std::copy(comp.begin(), comp.end(), file.begin() + 8);
+    WriteAllBytes(path_of(key), file);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Item item{ file.size(), std::filesystem::file_time_type::clock::now() };
+    auto [it, inserted] = items_.emplace(key, item);
+    if (!inserted) { total_ -= it->second.size; it->second = item; }
+    total_ += item.size;
+    trim_locked();
+}
+
+// Drops the oldest entries down to 90% of the cap so eviction is not re-run
+// on every store once the cache is full.
+void LzssBlockCache::trim_locked() {
+    stats_.stored_bytes = total_;
+    if (total_ <= max_bytes_) return;
+    std::vector<std::pair<std::filesystem::file_time_type, std::string>> order;
+    order.reserve(items_.size());
+    for (auto& kv : items_)
+        if (!pending_.count(kv.first)) order.emplace_back(kv.second.last_use, kv.first);
+    std::sort(order.begin(), order.end());
+    uint64_t target = max_bytes_ - max_bytes_ / 10;
+    for (auto& o : order) {
+        if (total_ <= target) break;
+        std::error_code ec;
+        std::filesystem::remove(path_of(o.second), ec);
+        auto it = items_.find(o.second);
+        total_ -= it->second.size;
+        items_.erase(it);
+        ++stats_.evicted;
+    }
+    stats_.stored_bytes = total_;
+}
+
+LzssBlockCache::Stats LzssBlockCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+std::filesystem::path DefaultLzssCacheDir() {
+#ifdef _WIN32
+    if (const wchar_t* local = _wgetenv(L"LOCALAPPDATA"); local && *local)
+        return std::filesystem::path(local) / L"MACROSS_PS1_TOOL" / L"lzss_cache";
+#else
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+        return std::filesystem::path(xdg) / "macross_ps1_tool" / "lzss_cache";
+    if (const char* home = std::getenv("HOME"); home && *home)
+        return std::filesystem::path(home) / ".cache" / "macross_ps1_tool" / "lzss_cache";
+#endif
+    return std::filesystem::temp_directory_path() / "macross_ps1_tool_lzss_cache";
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "lzss.h"
+
+// On-disk cache of compressed blocks, addressed by a hash of the raw bytes,
+// the LzssParams and LZSS_CODEC_VERSION. One file per block; the total is
+// capped and the least recently used files are evicted first (recency is the
+// file's write time, refreshed on every hit, so it carries across runs).
+// A cached block is only returned after it decompresses back to the raw
+// input, so hash collisions or damaged files just count as misses.
+// compress() may be called from several threads at once.
+class LzssBlockCache {
+public:
+    static constexpr uint64_t DEFAULT_MAX_BYTES = 512ull << 20;
+
+    explicit LzssBlockCache(const std::filesystem::path& dir, uint64_t max_bytes = DEFAULT_MAX_BYTES);
+    LzssBlockCache(const LzssBlockCache&) = delete;
+    LzssBlockCache& operator=(const LzssBlockCache&) = delete;
+
+    // Same result as CompressLZSS_PSX(raw, params).
+    // `lzss_stats` as in CompressLZSS_PSX; a hit adds the stored stream's
+    // token counts and the time to fetch it, with no search work.
+    std::vector<uint8_t> compress(const std::vector<uint8_t>& raw, const LzssParams& params,
+                                  LzssStats* lzss_stats = nullptr);
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evicted = 0;
+        uint64_t stored_bytes = 0;   // cache size on disk after this run's stores/evictions
+        double hit_rate() const { return hits + misses ? (double)hits / (double)(hits + misses) : 0.0; }
+    };
+    Stats stats() const;
+
+private:
+    struct Item {
+        uint64_t size;
+        std::filesystem::file_time_type last_use;
+    };
+
+    std::filesystem::path path_of(const std::string& key) const;
+    void store(const std::string& key, const std::vector<uint8_t>& raw, const std::vector<uint8_t>& comp);
+    void trim_locked();
+
+    std::filesystem::path dir_;
+    uint64_t max_bytes_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Item> items_;
+    std::unordered_set<std::string> pending_;
+    uint64_t total_ = 0;
+    Stats stats_;
+};
+
+// Per-user cache directory (%LOCALAPPDATA% on Windows, XDG cache elsewhere).
+std::filesystem::path DefaultLzssCacheDir();
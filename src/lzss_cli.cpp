@@ -1,96 +1,588 @@
+#ifdef _WIN32
 #include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdio>
-#include <cwchar>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
+#include <memory>
+#include <tuple>
 
 #include "lzss.h"
+#include "lzss_auto.h"
+#include "lzss_cache.h"
+#include "lzss_scan.h"
+#include "cli_util.h"
+#include "disc.h"
+#include "fileio.h"
+#include "parallel.h"
 
 static void PrintUsage() {
-    std::wcout << L"MACROSS LZSS CLI (PS1-compatible)\n"
-               << L"Uso:\n"
-               << L"  lzss_cli compress  <input> [-o <out>] [-p rapido|equilibrado|maximo] [--no-lazy]\n"
-               << L"  lzss_cli decompress <input> [-o <out>] [--out-len <N>]\n\n"
-               << L"Padrões:\n"
-               << L"  -p equilibrado, lazy matching ativado\n"
-               << L"  compress out  = <input>.lzss\n"
-               << L"  decompress out = <input>.decomp.bin\n";
+    std::cout << "MACROSS LZSS CLI (PS1-compatible)\n"
+              << "Uso:\n"
+              << "  lzss_cli compress  <input> [-o <out>] [-p rapido|equilibrado|maximo|otimo|auto] [-m hash|arvore] [--no-lazy] [--alvo <R>] [--stats] [<cache>]\n"
+              << "  lzss_cli decompress <input> [-o <out>] [--out-len <N>] [--stats]\n"
+              << "  lzss_cli batch <manifesto.txt> [-j <N>] [-p <perfil>] [-m hash|arvore] [--no-lazy] [--alvo <R>] [<cache>]\n"
+              << "  lzss_cli batch \"<pasta>/<glob>\" [--op compress|decompress] [-o <pasta_saida>] [-j <N>] [-p <perfil>] [-m hash|arvore] [--no-lazy] [--alvo <R>] [<cache>]\n"
+              << "  lzss_cli scan <arquivo...> [--disco] [-j <N>] [--min <bytes>] [--max <bytes>] [--confianca <C>] [-o <pasta>]\n\n"
+              << "Cache de blocos comprimidos (<cache>):\n"
+              << "  --cache              usa o cache no diretório padrão do usuário\n"
+              << "  --cache-dir <pasta>  usa o cache em <pasta>\n"
+              << "  --cache-mb <N>       limite do cache em MB (padrão 512, remove os menos usados)\n\n"
+              << "Padrões:\n"
+              << "  -p equilibrado, lazy matching ativado\n"
+              << "  -m: busca de matches; otimo usa arvore, os demais hash (use -m depois de -p)\n"
+              << "  -p auto: comprime com todos os perfis em paralelo e fica com a menor saída\n"
+              << "  --alvo <R>: com auto, para no primeiro perfil com saída <= R * entrada (ex.: 0.5)\n"
+              << "  --stats: imprime estatísticas do codec em JSON na saída padrão (o resumo vai para stderr)\n"
+              << "  compress out  = <input>.lzss\n"
+              << "  decompress out = <input>.decomp.bin\n"
+              << "  batch: -j = número de núcleos, --op compress\n"
+              << "  <input> ou -o igual a '-' usa stdin/stdout, em fluxo e com memória fixa\n"
+              << "  (compress: sem perfis otimo/auto e sem cache)\n\n"
+              << "scan: procura streams LZSS em qualquer offset; um JSON por linha com offset, tamanhos\n"
+              << "  comprimido/descomprimido e confiança (0-1). --disco: cada entrada é uma imagem\n"
+              << "  (.cue/.bin/.iso) e cada arquivo dela é varrido. -o grava cada stream descomprimido.\n"
+              << "  Padrões: --min 256, --max 4194304, --confianca 0.5\n\n"
+              << "Manifesto (uma tarefa por linha, campos separados por TAB, '#' = comentário):\n"
+              << "  <compress|decompress> <input> [<output>] [<perfil>] [<out-len>]\n"
+              << "  Campos vazios ou '-' usam o padrão.\n";
 }
 
-static bool ReadAll(const std::filesystem::path& p, std::vector<uint8_t>& buf) {
-    std::ifstream f(p, std::ios::binary);
-    if (!f) return false;
-    f.seekg(0, std::ios::end);
-    auto sz = (size_t)f.tellg();
-    f.seekg(0, std::ios::beg);
-    buf.resize(sz);
-    f.read((char*)buf.data(), sz);
-    return true;
+static std::filesystem::path DefaultOutput(bool compress, const std::filesystem::path& in) {
+    auto s = in.native();
+    return compress ? std::filesystem::path(s + std::filesystem::path(".lzss").native())
+                    : std::filesystem::path(s + std::filesystem::path(".decomp.bin").native());
 }
-static bool WriteAll(const std::filesystem::path& p, const std::vector<uint8_t>& buf) {
-    std::ofstream f(p, std::ios::binary);
-    if (!f) return false;
-    f.write((const char*)buf.data(), buf.size());
-    return true;
+
+// ===== Batch =====
+struct BatchJob {
+    size_t line = 0;              // manifest line, 0 for glob jobs
+    bool compress = true;
+    std::filesystem::path in, out;
+    LzssParams params;
+    bool auto_profile = false;
+    size_t out_len = 0;
+};
+
+struct BatchResult {
+    bool ok = false;
+    std::string error;
+    size_t in_bytes = 0, out_bytes = 0;
+    double seconds = 0;
+    std::string profile;          // auto: the profile that won
+};
+
+static std::string Trim(const std::string& s) {
+    size_t a = s.find_first_not_of(" \r\n");
+    if (a == std::string::npos) return "";
+    size_t b = s.find_last_not_of(" \r\n");
+    return s.substr(a, b - a + 1);
 }
 
-int wmain(int argc, wchar_t** argv) {
-    if (argc < 3) { PrintUsage(); return 1; }
+static std::vector<BatchJob> ReadManifest(const std::filesystem::path& manifest, const LzssParams& defaults,
+                                          bool default_auto) {
+    std::ifstream f(manifest);
+    if (!f) throw std::runtime_error("Erro ao ler manifesto: " + PathU8(manifest));
+    std::vector<BatchJob> jobs;
+    std::string line;
+    size_t lineno = 0;
+    while (std::getline(f, line)) {
+        ++lineno;
+        std::string t = Trim(line);
+        if (t.empty() || t[0] == '#') continue;
+        std::vector<std::string> fields;
+        size_t start = 0;
+        for (;;) {
+            size_t tab = t.find('\t', start);
+            fields.push_back(Trim(t.substr(start, tab == std::string::npos ? std::string::npos : tab - start)));
+            if (tab == std::string::npos) break;
+            start = tab + 1;
+        }
+        auto field = [&](size_t i) -> std::string {
+            return i < fields.size() && fields[i] != "-" ? fields[i] : std::string();
+        };
+        auto bad = [&](const std::string& why) {
+            return std::runtime_error("Manifesto linha " + std::to_string(lineno) + ": " + why);
+        };
+
+        BatchJob job;
+        job.line = lineno;
+        job.params = defaults;
+        job.auto_profile = default_auto;
+        if (field(0) == "compress") job.compress = true;
+        else if (field(0) == "decompress") job.compress = false;
+        else throw bad("operação inválida '" + fields[0] + "'");
+        if (field(1).empty()) throw bad("entrada ausente");
+        job.in = U8Path(field(1));
+        job.out = field(2).empty() ? DefaultOutput(job.compress, job.in) : U8Path(field(2));
+        if (!field(3).empty() && !ApplyProfileOrAuto(field(3), job.params, job.auto_profile))
+            throw bad("perfil inválido '" + field(3) + "'");
+        if (!field(4).empty()) job.out_len = (size_t)std::strtoull(field(4).c_str(), nullptr, 10);
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+static std::vector<BatchJob> ExpandGlob(const std::filesystem::path& pattern, bool compress,
+                                        const std::filesystem::path& outdir, const LzssParams& defaults,
+                                        bool default_auto) {
+    std::filesystem::path dir = pattern.parent_path();
+    if (dir.empty()) dir = ".";
+    std::string pat = PathU8(pattern.filename());
+    std::vector<std::filesystem::path> matches;
+    for (auto const& e : std::filesystem::directory_iterator(dir)) {
+        if (e.is_regular_file() && GlobMatch(pat.c_str(), PathU8(e.path().filename()).c_str()))
+            matches.push_back(e.path());
+    }
+    std::sort(matches.begin(), matches.end());
+    std::vector<BatchJob> jobs;
+    for (auto& p : matches) {
+        BatchJob job;
+        job.compress = compress;
+        job.in = p;
+        job.out = DefaultOutput(compress, outdir.empty() ? p : outdir / p.filename());
+        job.params = defaults;
+        job.auto_profile = default_auto;
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+// Compresses `input` with every auto profile on `threads` workers; returns the
+// smallest output and stores the winning profile's name in `profile`.
+static std::vector<uint8_t> CompressAuto(const std::vector<uint8_t>& input, const LzssParams& params,
+                                         double target_ratio, unsigned threads,
+                                         LzssBlockCache* cache, std::string& profile) {
+    LzssAutoOptions opt;
+    opt.profiles = LzssAutoProfiles(params.lazy_matching);
+    opt.target_ratio = target_ratio;
+    auto results = CompressLZSS_Auto({ input }, opt, threads, cache);
+    profile = opt.profiles[results[0].winner].name;
+    return std::move(results[0].data);
+}
+
+// Batch jobs already run one per core, so an auto job races its profiles on its own thread.
+static BatchResult RunJob(const BatchJob& job, LzssBlockCache* cache, double target_ratio) {
+    BatchResult r;
+    auto t0 = std::chrono::steady_clock::now();
+    try {
+        auto input = ReadAllBytes(job.in);
+        auto output = !job.compress     ? DecompressLZSS_PSX(input, job.out_len)
+                    : job.auto_profile  ? CompressAuto(input, job.params, target_ratio, 1, cache, r.profile)
+                    : cache             ? cache->compress(input, job.params)
+                                        : CompressLZSS_PSX(input, job.params);
+        WriteAllBytes(job.out, output);
+        r.in_bytes = input.size();
+        r.out_bytes = output.size();
+        r.ok = true;
+    } catch (const std::exception& e) {
+        r.error = e.what();
+    }
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return r;
+}
 
-    std::wstring cmd = argv[1];
-    std::filesystem::path in = argv[2];
+// Throughput is measured on the uncompressed side of each job.
+static double RawMBps(const BatchJob& job, const BatchResult& r, double seconds) {
+    size_t raw = job.compress ? r.in_bytes : r.out_bytes;
+    return seconds > 0 ? raw / seconds / 1e6 : 0.0;
+}
+
+static int RunBatch(const Args& args) {
+    if (args.size() < 3) { PrintUsage(); return 1; }
+    std::string source = args[2];
+    LzssParams defaults;
+    bool auto_profile = false;
+    double target_ratio = 0.0;
+    unsigned threads = 0;
+    bool compress = true;
+    std::filesystem::path outdir;
+    CacheOptions cache_opt;
+    for (size_t i = 3; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        if (ParseCacheOption(args, i, cache_opt)) continue;
+        if ((a == "-j" || a == "--jobs") && i + 1 < args.size()) threads = (unsigned)std::strtoul(args[++i].c_str(), nullptr, 10);
+        else if (a == "-p" && i + 1 < args.size()) {
+            if (!ApplyProfileOrAuto(args[++i], defaults, auto_profile)) { std::cerr << "Perfil inválido: " << args[i] << "\n"; return 1; }
+        }
+        else if (a == "--alvo" && i + 1 < args.size()) target_ratio = std::strtod(args[++i].c_str(), nullptr);
+        else if (a == "-m" && i + 1 < args.size()) {
+            if (!ApplyMatcher(args[++i], defaults)) { std::cerr << "Busca inválida: " << args[i] << "\n"; return 1; }
+        }
+        else if (a == "--no-lazy") defaults.lazy_matching = false;
+        else if (a == "--op" && i + 1 < args.size()) compress = args[++i] != "decompress";
+        else if ((a == "-o" || a == "--out") && i + 1 < args.size()) outdir = U8Path(args[++i]);
+    }
+
+    std::vector<BatchJob> jobs;
+    try {
+        bool is_glob = source.find_first_of("*?") != std::string::npos;
+        jobs = is_glob ? ExpandGlob(U8Path(source), compress, outdir, defaults, auto_profile)
+                       : ReadManifest(U8Path(source), defaults, auto_profile);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+    if (jobs.empty()) { std::cerr << "Nenhuma tarefa encontrada em: " << source << "\n"; return 2; }
+
+    std::unique_ptr<LzssBlockCache> cache = OpenCache(cache_opt);
+    std::vector<BatchResult> results(jobs.size());
+    std::mutex print_mutex;
+    auto t0 = std::chrono::steady_clock::now();
+    ParallelFor(jobs.size(), threads, [&](size_t i) {
+        results[i] = RunJob(jobs[i], cache.get(), target_ratio);
+        const auto& job = jobs[i];
+        const auto& r = results[i];
+        char buf[128];
+        std::lock_guard<std::mutex> lock(print_mutex);
+        if (r.ok) {
+            std::snprintf(buf, sizeof(buf), "  [%zu -> %zu bytes, %.1f MB/s%s%s]\n",
+                          r.in_bytes, r.out_bytes, RawMBps(job, r, r.seconds),
+                          r.profile.empty() ? "" : ", perfil ", r.profile.c_str());
+            std::cout << "OK #" << (i + 1) << " " << (job.compress ? "compress " : "decompress ")
+                      << PathU8(job.in) << " -> " << PathU8(job.out) << buf;
+        } else {
+            std::cout << "ERRO #" << (i + 1) << " " << PathU8(job.in) << ": " << r.error << "\n";
+        }
+    });
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    size_t raw_total = 0, ok = 0;
+    std::vector<size_t> failed;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (!results[i].ok) { failed.push_back(i); continue; }
+        ++ok;
+        raw_total += jobs[i].compress ? results[i].in_bytes : results[i].out_bytes;
+    }
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "\nTotal: %zu/%zu tarefas OK, %zu bytes em %.2f s (%.1f MB/s, %u threads)\n",
+                  ok, jobs.size(), raw_total, wall, wall > 0 ? raw_total / wall / 1e6 : 0.0,
+                  ResolveThreadCount(threads, jobs.size()));
+    std::cout << buf;
+    PrintCacheStats(cache.get());
+    if (failed.empty()) return 0;
+
+    std::cerr << "Tarefas com falha:\n";
+    for (size_t i : failed) {
+        std::cerr << "  #" << (i + 1);
+        if (jobs[i].line) std::cerr << " (linha " << jobs[i].line << ")";
+        std::cerr << " " << PathU8(jobs[i].in) << ": " << results[i].error << "\n";
+    }
+    return 5;
+}
+
+// ===== Scan =====
+struct ScanTarget {
+    std::string name;                   // file on disk, or path inside the image
+    std::filesystem::path out_stem;     // -o file names: <stem>_<offset>.bin
+    SectorStream data;
+    uint32_t lba = 0;                   // first sector inside the image
+    bool on_disc = false;
+};
+
+static int RunScan(const Args& args) {
+    LzssScanOptions opt;
+    unsigned threads = 0;
+    bool disc = false;
+    std::filesystem::path outdir;
+    std::vector<std::string> inputs;
+    for (size_t i = 2; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        if ((a == "-j" || a == "--jobs") && i + 1 < args.size()) threads = (unsigned)std::strtoul(args[++i].c_str(), nullptr, 10);
+        else if (a == "--min" && i + 1 < args.size()) opt.min_output = (size_t)std::strtoull(args[++i].c_str(), nullptr, 10);
+        else if (a == "--max" && i + 1 < args.size()) opt.max_output = (size_t)std::strtoull(args[++i].c_str(), nullptr, 10);
+        else if (a == "--confianca" && i + 1 < args.size()) opt.min_confidence = std::strtod(args[++i].c_str(), nullptr);
+        else if ((a == "-o" || a == "--out") && i + 1 < args.size()) outdir = U8Path(args[++i]);
+        else if (a == "--disco") disc = true;
+        else if (!a.empty() && a[0] == '-') { std::cerr << "Opção desconhecida: " << a << "\n"; return 1; }
+        else inputs.push_back(a);
+    }
+    if (inputs.empty()) { PrintUsage(); return 1; }
+
+    std::vector<ScanTarget> targets;
+    std::vector<std::shared_ptr<const DiscImage>> images;
+    try {
+        for (auto& in : inputs) {
+            std::filesystem::path p = U8Path(in);
+            if (!disc) {
+                auto mapped = MapFile(p);
+                targets.push_back({ in, p.stem(), SectorStream(ByteView{ mapped->data(), mapped->size() }, mapped) });
+                continue;
+            }
+            images.push_back(std::make_shared<const DiscImage>(p));
+            for (auto& e : images.back()->entries()) {
+                if (e.is_dir || e.size == 0) continue;
+                // Same-named files in different directories must not share output names.
+                std::string flat = e.path;
+                std::replace(flat.begin(), flat.end(), '/', '_');
+                targets.push_back({ e.path, U8Path(flat).stem(), images.back()->open(e), e.lba, true });
+            }
+        }
+        if (!outdir.empty()) std::filesystem::create_directories(outdir);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+
+    // One file gets every thread for its chunks; several files run one per thread.
+    const bool many = targets.size() > 1;
+    std::vector<std::string> lines(targets.size());
+    std::vector<LzssScanStats> stats(targets.size());
+    std::atomic<size_t> failed{ 0 };
+    uint64_t bytes = 0;
+    for (auto& t : targets) bytes += t.data.size();
+    auto t0 = std::chrono::steady_clock::now();
+    ParallelFor(targets.size(), many ? threads : 1, [&](size_t i) {
+        const ScanTarget& t = targets[i];
+        try {
+            // Raw 2352-byte sectors are gathered once; everything else is scanned in place.
+            std::vector<uint8_t> gathered;
+            ByteView v = t.data.contiguous();
+            if (v.empty() && t.data.size() > 0) {
+                gathered = t.data.read_all();
+                v = ByteView{ gathered.data(), gathered.size() };
+            }
+            auto hits = ScanLZSS_PSX(v.data(), v.size(), opt, many ? 1 : threads, &stats[i]);
+            for (auto& h : hits) {
+                char buf[200];
+                std::snprintf(buf, sizeof(buf), ", \"offset\": %llu, \"compressed\": %u, \"decompressed\": %u, "
+                              "\"confidence\": %.3f, \"size_hint\": %s",
+                              (unsigned long long)h.offset, h.compressed, h.decompressed, h.confidence,
+                              h.size_hint ? "true" : "false");
+                lines[i] += "{\"file\": " + JsonString(t.name) + buf;
+                if (t.on_disc) lines[i] += ", \"lba\": " + std::to_string(t.lba + h.offset / CD_SECTOR_DATA);
+                lines[i] += "}\n";
+                if (outdir.empty()) continue;
+                std::snprintf(buf, sizeof(buf), "_%08llx.bin", (unsigned long long)h.offset);
+                std::vector<uint8_t> comp(v.data() + h.offset, v.data() + h.offset + h.compressed);
+                WriteAllBytes(outdir / (t.out_stem.native() + U8Path(buf).native()), DecompressLZSS_PSX(comp, h.decompressed));
+            }
+        } catch (const std::exception& e) {
+            lines[i] = "{\"file\": " + JsonString(t.name) + ", \"error\": " + JsonString(std::string(e.what())) + "}\n";
+            ++failed;
+        }
+    });
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    for (auto& l : lines) std::cout << l;
+
+    LzssScanStats total;
+    for (auto& s : stats) {
+        total.candidates += s.candidates;
+        total.decoded += s.decoded;
+        total.reported += s.reported;
+    }
+    char buf[200];
+    std::snprintf(buf, sizeof(buf), "Varredura: %llu offsets, %llu decodificados, %llu streams em %.2f s (%.1f MB/s)\n",
+                  (unsigned long long)total.candidates, (unsigned long long)total.decoded,
+                  (unsigned long long)total.reported, wall, wall > 0 ? bytes / wall / 1e6 : 0.0);
+    std::cerr << buf;
+    return failed ? 5 : 0;
+}
+
+// ===== Streaming (stdin/stdout) =====
+static void SetBinaryStdio() {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+}
+
+// Compresses or decompresses with LzssEncoder/LzssDecoder, reading `in` and
+// writing `out` chunk by chunk; either may be "-". Memory use does not depend
+// on the size of the data.
+static int RunStream(bool compress, const std::string& in, const std::string& out,
+                     const LzssParams& params, size_t out_len) {
+    constexpr size_t CHUNK = 1 << 16;
+    SetBinaryStdio();
+    std::FILE* src = in == "-" ? stdin : nullptr;
+    std::unique_ptr<MappedFile> mapped;
+    if (!src) {
+        try { mapped = std::make_unique<MappedFile>(U8Path(in)); }
+        catch (const std::exception&) { std::cerr << "Erro ao ler arquivo de entrada: " << in << "\n"; return 2; }
+    }
+    std::unique_ptr<AtomicFileWriter> file;
+    std::vector<uint8_t> inbuf(src ? CHUNK : 0), outbuf;
+    size_t in_total = 0, out_total = 0, mapped_pos = 0;
+    try {
+        if (out != "-") file = std::make_unique<AtomicFileWriter>(U8Path(out));
+        auto put = [&](const uint8_t* p, size_t n) {
+            if (file) file->write(p, n);
+            else if (std::fwrite(p, 1, n, stdout) != n)
+                throw std::runtime_error("Erro ao escrever na saída padrão");
+            out_total += n;
+        };
+        auto flush = [&]() {
+            put(outbuf.data(), outbuf.size());
+            outbuf.clear();
+        };
+        // Next input chunk; empty at the end of the input.
+        auto next = [&]() -> std::pair<const uint8_t*, size_t> {
+            if (mapped) {
+                size_t n = std::min(CHUNK, mapped->size() - mapped_pos);
+                const uint8_t* p = mapped->data() + mapped_pos;
+                mapped_pos += n;
+                return { p, n };
+            }
+            size_t n = std::fread(inbuf.data(), 1, inbuf.size(), src);
+            return { inbuf.data(), n };
+        };
+
+        if (compress) {
+            LzssEncoder enc(params);
+            for (auto [p, n] = next(); n > 0; std::tie(p, n) = next()) {
+                in_total += n;
+                enc.write(p, n, outbuf);
+                flush();
+            }
+            enc.finish(outbuf);
+            flush();
+        } else {
+            LzssDecoder dec(out_len);
+            outbuf.resize(CHUNK);
+            bool more = true;
+            while (more && !dec.finished()) {
+                auto [p, n] = next();
+                in_total += n;
+                more = n > 0;
+                // Keep draining until the decoder stops filling the buffer.
+                for (;;) {
+                    auto prog = dec.feed(p, n, outbuf.data(), outbuf.size());
+                    p += prog.consumed; n -= prog.consumed;
+                    put(outbuf.data(), prog.produced);
+                    if (prog.produced < outbuf.size() && (n == 0 || dec.finished())) break;
+                }
+            }
+        }
+        if (file) file->commit();
+        else if (std::fflush(stdout) != 0) throw std::runtime_error("Erro ao escrever na saída padrão");
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 3;
+    }
+    std::cerr << "OK: " << in << " -> " << out << "  [" << in_total << " -> " << out_total << " bytes]\n";
+    return 0;
+}
+
+// ===== Single file =====
+static int RunCli(const Args& args) {
+    if (args.size() < 3) { PrintUsage(); return 1; }
+
+    const std::string& cmd = args[1];
+    if (cmd == "batch") return RunBatch(args);
+    if (cmd == "scan") return RunScan(args);
+
+    std::filesystem::path in = U8Path(args[2]);
     std::filesystem::path out;
-    bool lazy = true;
-    int bucket_limit = 128;
-    int max_candidates = 256;
+    LzssParams params;
+    bool auto_profile = false;
+    double target_ratio = 0.0;
+    bool want_stats = false;
     size_t out_len = 0; // only for decompress
+    CacheOptions cache_opt;
 
-    for (int i = 3; i < argc; ++i) {
-        std::wstring a = argv[i];
-        if ((a == L"-o" || a == L"--out") && i+1 < argc) {
-            out = argv[++i];
-        } else if (a == L"-p" && i+1 < argc) {
-            std::wstring prof = argv[++i];
-            if (prof == L"rapido" || prof == L"rápido") { bucket_limit = 64;  max_candidates = 128; }
-            else if (prof == L"maximo" || prof == L"máximo" || prof == L"maxima" || prof == L"máxima") { bucket_limit = 256; max_candidates = 1024; }
-            else { bucket_limit = 128; max_candidates = 256; } // equilibrado
-        } else if (a == L"--no-lazy") {
-            lazy = false;
-        } else if (a == L"--out-len" && i+1 < argc) {
-            out_len = (size_t)_wtoi(argv[++i]);
-        } else if (a == L"-h" || a == L"--help" || a == L"/?") {
+    for (size_t i = 3; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        if (ParseCacheOption(args, i, cache_opt)) continue;
+        if ((a == "-o" || a == "--out") && i+1 < args.size()) {
+            out = U8Path(args[++i]);
+        } else if (a == "-p" && i+1 < args.size()) {
+            if (!ApplyProfileOrAuto(args[++i], params, auto_profile)) { std::cerr << "Perfil inválido: " << args[i] << "\n"; return 1; }
+        } else if (a == "--alvo" && i+1 < args.size()) {
+            target_ratio = std::strtod(args[++i].c_str(), nullptr);
+        } else if (a == "-m" && i+1 < args.size()) {
+            if (!ApplyMatcher(args[++i], params)) { std::cerr << "Busca inválida: " << args[i] << "\n"; return 1; }
+        } else if (a == "--no-lazy") {
+            params.lazy_matching = false;
+        } else if (a == "--stats") {
+            want_stats = true;
+        } else if (a == "--out-len" && i+1 < args.size()) {
+            out_len = (size_t)std::strtoull(args[++i].c_str(), nullptr, 10);
+        } else if (a == "-h" || a == "--help" || a == "/?") {
             PrintUsage();
             return 0;
         }
     }
 
+    if (want_stats && (auto_profile || args[2] == "-" || PathU8(out) == "-")) {
+        std::cerr << "--stats precisa de arquivos de entrada e saída e de um perfil fixo.\n";
+        return 1;
+    }
+    // With --stats stdout carries only the JSON.
+    std::ostream& info = want_stats ? std::cerr : std::cout;
+    LzssStats stats;
+    LzssStats* st = want_stats ? &stats : nullptr;
+
+    if ((cmd == "compress" || cmd == "decompress") && (args[2] == "-" || PathU8(out) == "-")) {
+        bool compress = cmd == "compress";
+        if (compress && (params.optimal_parse || auto_profile)) {
+            std::cerr << "Os perfis otimo e auto precisam da entrada inteira; use um arquivo de entrada.\n";
+            return 1;
+        }
+        std::string out_name = out.empty() ? (args[2] == "-" ? "-" : PathU8(DefaultOutput(compress, in))) : PathU8(out);
+        return RunStream(compress, args[2], out_name, params, out_len);
+    }
+
     std::vector<uint8_t> input;
-    if (!ReadAll(in, input)) {
-        std::wcerr << L"Erro ao ler arquivo de entrada: " << in << L"\n";
+    try {
+        input = ReadAllBytes(in);
+    } catch (const std::exception&) {
+        std::cerr << "Erro ao ler arquivo de entrada: " << PathU8(in) << "\n";
         return 2;
     }
 
-    if (cmd == L"compress") {
-        if (out.empty()) out = in.wstring() + L".lzss";
-        auto comp = CompressLZSS_PSX(input, bucket_limit, max_candidates, lazy);
-        if (!WriteAll(out, comp)) {
-            std::wcerr << L"Erro ao salvar: " << out << L"\n"; return 3;
+    if (cmd == "compress") {
+        if (out.empty()) out = DefaultOutput(true, in);
+        std::unique_ptr<LzssBlockCache> cache = OpenCache(cache_opt);
+        std::string profile;
+        auto comp = auto_profile ? CompressAuto(input, params, target_ratio, 0, cache.get(), profile)
+                  : cache        ? cache->compress(input, params, st)
+                                 : CompressLZSS_PSX(input, params, st);
+        try {
+            WriteAllBytes(out, comp);
+        } catch (const std::exception&) {
+            std::cerr << "Erro ao salvar: " << PathU8(out) << "\n"; return 3;
         }
-        std::wcout << L"OK: " << in << L" -> " << out << L"  [" << comp.size() << L" bytes]\n";
+        info << "OK: " << PathU8(in) << " -> " << PathU8(out) << "  [" << comp.size() << " bytes"
+             << (profile.empty() ? "" : ", perfil " + profile) << "]\n";
+        PrintCacheStats(cache.get(), info);
+        if (st) std::cout << "{\"op\": \"compress\", " << StatsJsonFields(stats) << "}\n";
         return 0;
-    } else if (cmd == L"decompress") {
-        if (out.empty()) out = in.wstring() + L".decomp.bin";
-        auto decomp = DecompressLZSS_PSX(input, out_len);
-        if (!WriteAll(out, decomp)) {
-            std::wcerr << L"Erro ao salvar: " << out << L"\n"; return 3;
+    } else if (cmd == "decompress") {
+        if (out.empty()) out = DefaultOutput(false, in);
+        auto decomp = DecompressLZSS_PSX(input, out_len, st);
+        try {
+            WriteAllBytes(out, decomp);
+        } catch (const std::exception&) {
+            std::cerr << "Erro ao salvar: " << PathU8(out) << "\n"; return 3;
         }
-        std::wcout << L"OK: " << in << L" -> " << out << L"  [" << decomp.size() << L" bytes]\n";
+        info << "OK: " << PathU8(in) << " -> " << PathU8(out) << "  [" << decomp.size() << " bytes]\n";
+        if (st) std::cout << "{\"op\": \"decompress\", " << StatsJsonFields(stats) << "}\n";
         return 0;
     } else {
         PrintUsage();
         return 1;
     }
 }
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t** argv) {
+    SetConsoleOutputCP(CP_UTF8);
+    Args args;
+    for (int i = 0; i < argc; ++i) args.push_back(std::filesystem::path(argv[i]).u8string());
+    return RunCli(args);
+}
+#else
+int main(int argc, char** argv) {
+    return RunCli(Args(argv, argv + argc));
+}
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+// Match-length kernels for the compressor's match finders (and lzss_bench).
+// Matches are at most 18 bytes, so a single 16-byte SSE2 compare settles
+// nearly every candidate; wider vectors would only read further. SSE2 is part
+// of both x86 targets we build (x64, and Win32 with the default /arch), so the
+// wide kernel is chosen at compile time; other CPUs use the scalar loop.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LZSS_MATCH_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Byte-at-a-time reference: extends a common prefix of `len` bytes up to max_len.
+inline int MatchLengthScalar(const uint8_t* a, const uint8_t* b, int len, int max_len) {
+    while (len < max_len && a[len] == b[len]) ++len;
+    return len;
+}
+
+// Same result as MatchLengthScalar. `readable` is how many bytes may be read
+// at both a and b (at least max_len); the vector path only runs when 16 are,
+// so nothing past the end of the input is touched.
+inline int MatchLength(const uint8_t* a, const uint8_t* b, int len, int max_len, int readable) {
+#ifdef LZSS_MATCH_SSE2
+    if (readable >= 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)a);
+        __m128i vb = _mm_loadu_si128((const __m128i*)b);
+        uint32_t diff = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & 0xFFFF;
+        if (diff) {
+#ifdef _MSC_VER
+            unsigned long first;
+            _BitScanForward(&first, diff);
+#else
+            int first = __builtin_ctz(diff);
+#endif
+            return (int)first < max_len ? (int)first : max_len;
+        }
+        len = 16;
+    }
+#else
+    (void)readable;
+#endif
+    return MatchLengthScalar(a, b, len, max_len);
+}
@@ -0,0 +1,389 @@
+#include "lzss_scan.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+
+namespace {
+    // Same stream layout as the decoder in lzss.cpp.
+    constexpr int RING_INIT     = 0xFEE;
+    constexpr int WINDOW_SIZE   = 4096;
+    constexpr int MIN_MATCH     = 3;
+    constexpr int MAX_MATCH     = 18;
+    // Zeros just before RING_INIT that an encoder may match before any output
+    // exists (Okumura's LZSS and CompressLZSS_PSX alike).
+    constexpr int ZERO_PREFIX   = MAX_MATCH;
+    // Output bytes the token walk looks at before a full decode.
+    constexpr uint64_t PROBE_BYTES = 512;
+    // Change-point threshold (nats) for "the tokens now look random".
+    constexpr double END_THRESHOLD = 25.0;
+
+    inline size_t MatchDistance(uint64_t pos, uint8_t b1, uint8_t b2) {
+        const int off = ((b2 & 0xF0) << 4) | b1;
+        size_t dist = (size_t)(((int)((RING_INIT + pos) & 0x0FFF) - off) & 0x0FFF);
+        return dist ? dist : WINDOW_SIZE;
+    }
+
+    // The match reads bytes from before the stream that no encoder could have seen.
+    inline bool ReadsUnwritten(uint64_t pos, size_t dist) {
+        return dist > pos + ZERO_PREFIX;
+    }
+
+    // Chance that a match token made of bytes like those around it passes the
+    // unwritten-space check. Compressed data is close to uniform bytes, where
+    // this is (pos + ZERO_PREFIX) / WINDOW_SIZE; low-entropy data (all bytes
+    // below 16, say) passes it far more often and must not count as evidence.
+    // The byte histogram is local (ODDS_BLOCK steps, twice that wide), since
+    // a candidate often straddles different kinds of data.
+    class OffsetOdds {
+    public:
+        OffsetOdds(const uint8_t* d, size_t n) : d_(d), n_(n) {}
+
+        // Match at input position src, output position pos < WINDOW_SIZE - ZERO_PREFIX;
+        // the readable ring offsets are [RING_INIT - ZERO_PREFIX, RING_INIT + pos).
+        double pass(size_t src, uint64_t pos) {
+            const double* cdf = block(src / ODDS_BLOCK);
+            const size_t a = RING_INIT - ZERO_PREFIX, e = a + (size_t)pos + ZERO_PREFIX;
+            if (e <= WINDOW_SIZE) return cdf[e] - cdf[a];
+            return cdf[WINDOW_SIZE] - cdf[a] + cdf[e - WINDOW_SIZE];
+        }
+
+    private:
+        static constexpr size_t ODDS_BLOCK = 512;
+
+        const double* block(size_t k) {
+            if (k >= built_.size()) built_.resize(k + 1, false);
+            if (cdf_.size() < (k + 1) * (WINDOW_SIZE + 1)) cdf_.resize((k + 1) * (WINDOW_SIZE + 1));
+            double* cdf = &cdf_[k * (WINDOW_SIZE + 1)];
+            if (built_[k]) return cdf;
+            const size_t from = k * ODDS_BLOCK, to = std::min(n_, from + 2 * ODDS_BLOCK);
+            double lo[256], hi[16] = {};
+            std::fill(std::begin(lo), std::end(lo), 0.01);
+            for (size_t i = from; i < to; ++i) lo[d_[i]] += 1;
+            for (int b = 0; b < 256; ++b) hi[b >> 4] += lo[b];
+            const double total = (to - from) + 2.56;
+            cdf[0] = 0;
+            for (int off = 0; off < WINDOW_SIZE; ++off)
+                cdf[off + 1] = cdf[off] + lo[off & 0xFF] / total * (hi[off >> 8] / total);
+            built_[k] = true;
+            return cdf;
+        }
+
+        const uint8_t* d_;
+        size_t n_;
+        std::vector<double> cdf_;
+        std::vector<bool> built_;
+    };
+
+    inline uint32_t ReadU32(const uint8_t* p) {
+        return (uint32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+    }
+
+    // Token walk over the first PROBE_BYTES of output; false = not a stream.
+    bool Probe(const uint8_t* d, size_t n, size_t min_output, bool coverage) {
+        size_t src = 0;
+        uint64_t pos = 0, matched = 0;
+        int same = 0;          // identical bytes coded as consecutive literals
+        uint8_t last = 0;
+        while (pos < PROBE_BYTES) {
+            if (src >= n) return pos >= min_output && (!coverage || matched * 64 >= pos);
+            const uint8_t flags = d[src++];
+            for (int bit = 0; bit < 8 && pos < PROBE_BYTES; ++bit) {
+                if ((flags & (0x80 >> bit)) == 0) {
+                    if (src >= n) return pos >= min_output && (!coverage || matched * 64 >= pos);
+                    const uint8_t b = d[src++];
+                    same = (same && b == last) ? same + 1 : 1;
+                    if (same >= 4) return false;
+                    last = b;
+                    ++pos;
+                } else {
+                    if (src + 2 > n) return pos >= min_output && (!coverage || matched * 64 >= pos);
+                    const uint8_t b1 = d[src], b2 = d[src + 1];
+                    src += 2;
+                    if (ReadsUnwritten(pos, MatchDistance(pos, b1, b2))) return false;
+                    const int len = (b2 & 0x0F) + MIN_MATCH;
+                    pos += len;
+                    matched += len;
+                    same = 0;
+                }
+            }
+        }
+        // Real data this short into a stream is never almost all literals
+        // (unless it is incompressible, which only a header can vouch for).
+        return !coverage || matched * 64 >= pos;
+    }
+
+    // Token statistics of the recent stream (exponentially forgetting,
+    // Laplace-smoothed), to tell its tokens from the uniform ones that the
+    // bytes past its end decode to.
+    struct TokenModel {
+        double literals = 1, matches = 1;
+        double length[16];
+        // floor(log2(distance)), or REPEAT for the previous match's distance
+        // again: copies longer than MAX_MATCH come out as runs of those.
+        static constexpr int REPEAT = 13;
+        double bucket[14];
+        double length_total = 16, bucket_total = 14;
+        size_t last_dist = 0;
+        double weight = 1;     // grows instead of decaying every count
+        TokenModel() {
+            std::fill(std::begin(length), std::end(length), 1.0);
+            std::fill(std::begin(bucket), std::end(bucket), 1.0);
+        }
+        int Bucket(size_t dist) const {
+            if (dist == last_dist) return REPEAT;
+            int b = 0;
+            while ((dist >>= 1) != 0) ++b;
+            return b;
+        }
+        void age() {
+            weight *= 1.0 / 0.999;   // half-life of about 700 tokens
+            if (weight < 1e100) return;
+            for (double& v : length) v /= weight;
+            for (double& v : bucket) v /= weight;
+            literals /= weight; matches /= weight; length_total /= weight; bucket_total /= weight;
+            weight = 1;
+        }
+        void add_literal() { age(); literals += weight; }
+        void add_match(int len, size_t dist) {
+            age();
+            matches += weight;
+            length[len - MIN_MATCH] += weight; length_total += weight;
+            bucket[Bucket(dist)] += weight; bucket_total += weight;
+            last_dist = dist;
+        }
+        // ln(P_random / P_stream) of each token; random = fair flag bits,
+        // uniform length and distance. Literals only ever count for the
+        // stream: runs of new bytes are normal in real data.
+        double literal_llr() const { return std::min(0.0, std::log(0.5 * (literals + matches) / literals)); }
+        double match_llr(int len, size_t dist) const {
+            const int b = Bucket(dist);
+            const double width = b >= 12 ? 1.0 : (double)(1 << b);
+            const double p_stream = matches / (literals + matches) * (length[len - MIN_MATCH] / length_total)
+                                  * (bucket[b] / bucket_total) / width;
+            return std::log(0.5 / 16.0 / WINDOW_SIZE / p_stream);
+        }
+    };
+
+    struct Decoded {
+        size_t comp = 0;          // input bytes up to the last plausible token
+        uint64_t out = 0;
+        double log_random = 0;    // ln of the chance that random bytes pass the same checks
+        bool runaway = false;     // stopped by max_output
+        // First token boundary at or past each size hint (comp, out); 0 = not reached.
+        size_t hint_comp[2] = {};
+        uint64_t hint_out[2] = {};
+    };
+
+    // Decodes until the stream stops looking encoder-made: a token no encoder
+    // emits, or (past the first window, where every match is valid) a CUSUM
+    // of the tokens' random-vs-stream log-likelihood crossing END_THRESHOLD,
+    // which ends it where the sum last left zero. While a size hint is still
+    // ahead, decoding goes on past that soft end so the hint can be checked.
+    // `out` is scratch.
+    Decoded Decode(const uint8_t* d, size_t n, size_t max_output, const uint32_t hints[2], std::vector<uint8_t>& out) {
+        Decoded r;
+        out.clear();
+        size_t src = 0;
+        uint64_t pos = 0;
+        int same = 0;                 // consecutive literals of the same byte
+        size_t run_comp = 0;          // where that literal run starts
+        uint64_t run_out = 0;
+        TokenModel model;
+        OffsetOdds odds(d, n);
+        double cusum = 0;
+        size_t calm_comp = 0;         // last token boundary with cusum == 0
+        uint64_t calm_out = 0;
+        bool soft_end = false;        // r.comp/r.out hold the CUSUM end
+        auto end_at = [&](size_t comp, uint64_t o) {
+            if (soft_end) return r;
+            r.comp = comp;
+            r.out = o;
+            return r;
+        };
+        auto hint_pending = [&]() {
+            for (int k = 0; k < 2; ++k)
+                if (hints[k] && !r.hint_out[k]) return true;
+            return false;
+        };
+        while (src < n) {
+            const size_t group = src;
+            const uint8_t flags = d[src++];
+            for (int bit = 0; bit < 8; ++bit) {
+                // A token that turns out implausible ends the stream before its flag byte
+                // when it is the first of its group.
+                const size_t token = bit == 0 ? group : src;
+                if (pos >= max_output) { r.runaway = !soft_end; return end_at(token, pos); }
+                if ((flags & (0x80 >> bit)) == 0) {
+                    if (src >= n) return end_at(token, pos);
+                    const uint8_t b = d[src];
+                    if (same && b == out.back()) {
+                        ++same;
+                    } else {
+                        same = 1;
+                        run_comp = token;
+                        run_out = pos;
+                    }
+                    // Three literals repeating the byte before them: a distance-1 match was cheaper.
+                    const uint8_t before = pos >= 3 ? out[pos - 3] : 0;
+                    if (same >= 3 && before == b) return end_at(run_comp, run_out);
+                    if (pos >= WINDOW_SIZE) cusum = std::max(0.0, cusum + model.literal_llr());
+                    model.add_literal();
+                    out.push_back(b);
+                    ++src;
+                    ++pos;
+                } else {
+                    if (src + 2 > n) return end_at(token, pos);
+                    const uint8_t b1 = d[src], b2 = d[src + 1];
+                    const size_t dist = MatchDistance(pos, b1, b2);
+                    if (ReadsUnwritten(pos, dist)) return end_at(token, pos);
+                    if (pos + ZERO_PREFIX < WINDOW_SIZE)
+                        r.log_random += std::log(odds.pass(src, pos));
+                    src += 2;
+                    const int len = (b2 & 0x0F) + MIN_MATCH;
+                    if (pos >= WINDOW_SIZE) cusum = std::max(0.0, cusum + model.match_llr(len, dist));
+                    model.add_match(len, dist);
+                    for (int k = 0; k < len; ++k) {
+                        const uint64_t from = pos + k - dist;
+                        out.push_back(pos + k >= dist ? out[(size_t)from] : 0);
+                    }
+                    pos += len;
+                    same = 0;
+                }
+                for (int k = 0; k < 2; ++k)
+                    if (hints[k] && !r.hint_out[k] && pos >= hints[k]) { r.hint_comp[k] = src; r.hint_out[k] = pos; }
+                if (!soft_end) {
+                    r.comp = src;
+                    r.out = pos;
+                    if (cusum == 0) {
+                        calm_comp = src;
+                        calm_out = pos;
+                    } else if (cusum > END_THRESHOLD) {
+                        r.comp = calm_comp;
+                        r.out = calm_out;
+                        soft_end = true;
+                    }
+                }
+                if (soft_end && !hint_pending()) return r;
+            }
+        }
+        return end_at(src, pos);
+    }
+
+    // How unlikely bytes like the candidate's are to pass the match checks that
+    // the stream passed: full confidence at 1e-20, as a disc has ~1e9 offsets.
+    double Confidence(const Decoded& dec) {
+        double c = std::min(1.0, -dec.log_random / std::log(10.0) / 20.0);
+        if (dec.runaway) c *= 0.6;
+        return c;
+    }
+
+    // Candidates [begin, end) of data[0, size).
+    void ScanRange(const uint8_t* data, size_t size, size_t begin, size_t end, const LzssScanOptions& o,
+                   std::vector<LzssScanHit>& hits, LzssScanStats& st) {
+        std::vector<uint8_t> scratch;
+        for (size_t off = begin; off < end; ++off) {
+            ++st.candidates;
+            // PUD-style headers put dsize, csize right before the data; others just a size.
+            uint32_t hints[2] = {};
+            const uint32_t h4 = off >= 4 ? ReadU32(data + off - 4) : 0;
+            const uint32_t h8 = off >= 8 ? ReadU32(data + off - 8) : 0;
+            if (h8 >= o.min_output && h8 <= o.max_output) hints[0] = h8;
+            if (h4 >= o.min_output && h4 <= o.max_output) hints[1] = h4;
+            // Worst case (all literals) csize is 9/8 of dsize.
+            const bool pud_header = hints[0] && h4 != 0 && h4 <= hints[0] + hints[0] / 8 + 2;
+            bool header_only = false;   // passed only because of the header: it must match exactly
+            if (!Probe(data + off, size - off, o.min_output, true)) {
+                if (!pud_header || !Probe(data + off, size - off, o.min_output, false)) continue;
+                header_only = true;
+            }
+            ++st.decoded;
+
+            Decoded dec = Decode(data + off, size - off, o.max_output, hints, scratch);
+
+            LzssScanHit h;
+            h.offset = off;
+            size_t comp = dec.comp;
+            uint64_t out = dec.out;
+            double conf;
+            // A real stream ends on a token boundary exactly at its decoded size.
+            if (pud_header && dec.hint_out[0] == hints[0] && dec.hint_comp[0] <= h4 && h4 <= dec.hint_comp[0] + 1) {
+                // dsize and csize both agree with the decode (csize may carry a padding
+                // byte): reported whatever its ratio.
+                h.compressed = h4;
+                h.decompressed = hints[0];
+                h.confidence = 1.0;
+                h.size_hint = true;
+                hits.push_back(h);
+                ++st.reported;
+                continue;
+            }
+            if (header_only) continue;
+            if (hints[1] && dec.hint_out[1] == hints[1]) {
+                comp = dec.hint_comp[1];
+                out = dec.hint_out[1];
+                h.size_hint = true;
+                // Random tokens land exactly on a given size about one time in eight.
+                dec.log_random += std::log(1.0 / 8);
+                conf = Confidence(dec);
+            } else {
+                conf = Confidence(dec);
+            }
+            if (out < o.min_output || comp == 0 || (double)out / comp < o.min_ratio || conf < o.min_confidence)
+                continue;
+            h.compressed = (uint32_t)comp;
+            h.decompressed = (uint32_t)out;
+            h.confidence = conf;
+            hits.push_back(h);
+            ++st.reported;
+        }
+    }
+}
+
+std::vector<LzssScanHit> ScanLZSS_PSX(const uint8_t* data, size_t size, const LzssScanOptions& options,
+                                      unsigned threads, LzssScanStats* stats) {
+    const auto t0 = std::chrono::steady_clock::now();
+    const size_t chunk = std::max<size_t>(1, options.chunk_size);
+    const size_t jobs = (size + chunk - 1) / chunk;
+    std::vector<std::vector<LzssScanHit>> found(jobs);
+    std::vector<LzssScanStats> job_stats(jobs);
+    ParallelFor(jobs, threads, [&](size_t j) {
+        ScanRange(data, size, j * chunk, std::min(size, (j + 1) * chunk), options, found[j], job_stats[j]);
+    });
+
+    // Overlaps, in offset order. A hit inside a stream whose size a header
+    // confirmed is its tokens read out of step and is dropped; so is one
+    // without a header of its own that is less confident or ends within the
+    // earlier stream (a tail of it, decoded from a later token or one read
+    // out of step). Otherwise the earlier stream cannot run past the start
+    // of the later one and is cut there.
+    std::vector<LzssScanHit> all, kept;
+    for (auto& f : found) all.insert(all.end(), f.begin(), f.end());
+    std::vector<uint8_t> scratch;
+    const uint32_t no_hints[2] = {};
+    for (auto& h : all) {
+        if (!kept.empty()) {
+            LzssScanHit& k = kept.back();
+            if (h.offset < k.offset + k.compressed) {
+                const bool inside = h.offset + h.compressed <= k.offset + k.compressed;
+                if (k.size_hint || (!h.size_hint && (inside || h.confidence < k.confidence))) continue;
+                Decoded cut = Decode(data + k.offset, (size_t)(h.offset - k.offset), options.max_output, no_hints, scratch);
+                k.compressed = (uint32_t)cut.comp;
+                k.decompressed = (uint32_t)cut.out;
+                if (cut.out < options.min_output) kept.pop_back();
+            }
+        }
+        kept.push_back(h);
+    }
+
+    if (stats) {
+        for (auto& s : job_stats) {
+            stats->candidates += s.candidates;
+            stats->decoded += s.decoded;
+        }
+        stats->reported += kept.size();
+        stats->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+    return kept;
+}
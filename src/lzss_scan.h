@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Finds PS1 LZSS streams at unknown offsets inside arbitrary data.
+//
+// The format has no header and no end marker, so every byte offset is a
+// candidate. A cheap token walk (no output) rejects almost all of them:
+//  - a match reaching into ring space never written before the stream start
+//    (an encoder can only see the 18 zeros just before 0xFEE);
+//  - a run of 4 identical bytes coded as literals (a distance-1 match is
+//    always cheaper, so no encoder emits it);
+//  - fewer than 1 in 64 of the first 512 output bytes coming from matches,
+//    unless a PUD-style header (u32 dsize, u32 csize) comes right before.
+// Survivors are decoded until the stream stops looking encoder-made (the same
+// rules, now with the output at hand, or token statistics turning into the
+// uniform ones of random bytes), the data ends or max_output is reached.
+
+struct LzssScanOptions {
+    size_t min_output = 256;         // shortest decoded payload reported
+    size_t max_output = 4u << 20;    // decode limit per candidate
+    double min_ratio = 1.1;          // decoded/compressed below this is not reported,
+                                     // unless a PUD-style header matches exactly
+    double min_confidence = 0.5;
+    size_t chunk_size = 1u << 20;    // candidate offsets per parallel job
+};
+
+struct LzssScanHit {
+    uint64_t offset = 0;
+    uint32_t compressed = 0;         // best estimate of the stream's length
+    uint32_t decompressed = 0;
+    double confidence = 0;           // 0..1
+    // A u32 just before the stream gives the decoded size (and, with a
+    // second u32, the compressed size, as in a PUD block header).
+    bool size_hint = false;
+};
+
+struct LzssScanStats {
+    uint64_t candidates = 0;         // offsets tested
+    uint64_t decoded = 0;            // survivors of the token walk
+    uint64_t reported = 0;
+    double seconds = 0;
+};
+
+// Scans data[0, size) in chunk_size jobs on `threads` workers (0 = all cores).
+// Overlapping hits are resolved in offset order: a hit inside a stream whose
+// header sizes agree is dropped, and so is one without header sizes of its
+// own that is less confident or ends within that stream; otherwise the
+// earlier stream is cut where the later one starts. Sorted by offset; the
+// result does not depend on the thread count.
+std::vector<LzssScanHit> ScanLZSS_PSX(const uint8_t* data, size_t size,
+                                      const LzssScanOptions& options = LzssScanOptions(),
+                                      unsigned threads = 0, LzssScanStats* stats = nullptr);
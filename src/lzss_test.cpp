@@ -0,0 +1,982 @@
+// Self-checking tests for the codec and the PUD builder. Every case runs on
+// reproducible synthetic data; failures are printed as they happen and the
+// exit code is the number of failed tests (0 = all passed).
+//   lzss_test            all tests
+//   lzss_test <texto>    only tests whose name contains <texto>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "disc.h"
+#include "fileio.h"
+#include "gko.h"
+#include "lzss.h"
+#include "lzss_auto.h"
+#include "lzss_scan.h"
+#include "pud.h"
+
+// ===== Harness =====
+static int g_failures = 0;   // failed checks in the running test
+
+static void Check(bool ok, const std::string& what) {
+    if (ok) return;
+    ++g_failures;
+    std::printf("  FALHOU: %s\n", what.c_str());
+}
+
+// Like the bench corpus, only raw mt19937 output is used, so the data is the
+// same on every compiler.
+static std::vector<uint8_t> MakeSample(std::mt19937& rng, size_t size) {
+    // Paletted rows with repeats, noise and zero gaps: every token kind and
+    // distance shows up.
+    std::vector<uint8_t> b(size, 0);
+    size_t i = 0;
+    while (i < size) {
+        const size_t run = 1 + rng() % 300;
+        switch (rng() % 4) {
+        case 0: break;                                                    // zeros
+        case 1: for (size_t k = 0; k < run && i + k < size; ++k) b[i + k] = (uint8_t)rng(); break;
+        case 2: {                                                         // repeat of earlier data
+            if (i == 0) break;
+            const size_t dist = 1 + rng() % std::min<size_t>(i, 4096);
+            for (size_t k = 0; k < run && i + k < size; ++k) b[i + k] = b[i + k - dist];
+            break;
+        }
+        default: {                                                        // gradient
+            const uint8_t base = (uint8_t)rng();
+            for (size_t k = 0; k < run && i + k < size; ++k) b[i + k] = (uint8_t)(base + k / 8);
+            break;
+        }
+        }
+        i += run;
+    }
+    return b;
+}
+
+static unsigned ManyThreads() {
+    return std::max(4u, std::thread::hardware_concurrency());
+}
+
+// ===== PUD: same bytes for any thread count =====
+static PudFile MakePudTemplate(const std::vector<std::vector<uint8_t>>& blocks) {
+    PudFile t{ "teste.pud", 0, 0x10, 0x00, {} };
+    uint32_t off = 4;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const uint32_t size = (uint32_t)blocks[i].size();
+        t.blocks.push_back(PudBlock{ (int)i, off, 16, 16, (uint16_t)i, 0, 0, 0, size, size, off + 20, off + 20 + size });
+        off += 20 + size;
+    }
+    t.size = off;
+    return t;
+}
+
+// Every block of `pud` decodes back to the raw block.
+static bool PudDecodesTo(const std::vector<uint8_t>& pud, const std::vector<std::vector<uint8_t>>& raw) {
+    PudFile f = ParsePUD(pud, "saida.pud");
+    if (f.blocks.size() != raw.size()) return false;
+    for (size_t i = 0; i < raw.size(); ++i) {
+        const auto& b = f.blocks[i];
+        std::vector<uint8_t> comp(pud.begin() + b.data_off, pud.begin() + b.data_end);
+        if (b.dsize != raw[i].size() || DecompressLZSS_PSX(comp, b.dsize) != raw[i]) return false;
+    }
+    return true;
+}
+
+static void TestPudThreads() {
+    std::mt19937 rng(0x50554431u);
+    std::vector<std::vector<uint8_t>> blocks;
+    for (int i = 0; i < 24; ++i) blocks.push_back(MakeSample(rng, 1 + rng() % 40000));
+    const PudFile tmpl = MakePudTemplate(blocks);
+    const unsigned n = ManyThreads();
+
+    struct Case { const char* name; LzssParams params; };
+    std::vector<Case> cases(4);
+    cases[0] = { "equilibrado", LzssParams() };
+    cases[1] = { "maximo", LzssParams() };
+    cases[1].params.bucket_limit = 256;
+    cases[1].params.max_candidates = 1024;
+    cases[2] = { "maximo arvore", cases[1].params };
+    cases[2].params.matcher = LzssMatcher::BinaryTree;
+    cases[3] = { "otimo", cases[2].params };
+    cases[3].params.optimal_parse = true;
+    for (const auto& c : cases) {
+        const auto one = BuildPUD_FromBlocks(tmpl, blocks, true, c.params, 1);
+        const auto many = BuildPUD_FromBlocks(tmpl, blocks, true, c.params, n);
+        Check(one == many, std::string("BuildPUD_FromBlocks ") + c.name + ": 1 e " + std::to_string(n) + " threads diferem");
+        Check(PudDecodesTo(one, blocks), std::string("BuildPUD_FromBlocks ") + c.name + ": blocos não voltam ao original");
+    }
+
+    const auto auto_one = BuildPUD_FromBlocksAuto(tmpl, blocks, LzssAutoOptions(), 1);
+    const auto auto_many = BuildPUD_FromBlocksAuto(tmpl, blocks, LzssAutoOptions(), n);
+    Check(auto_one == auto_many, "BuildPUD_FromBlocksAuto: 1 e " + std::to_string(n) + " threads diferem");
+    Check(PudDecodesTo(auto_one, blocks), "BuildPUD_FromBlocksAuto: blocos não voltam ao original");
+
+    const auto budget_one = BuildPUD_FromBlocksBudget(tmpl, blocks, {}, LzssAutoProfiles(), 1);
+    const auto budget_many = BuildPUD_FromBlocksBudget(tmpl, blocks, {}, LzssAutoProfiles(), n);
+    Check(budget_one == budget_many, "BuildPUD_FromBlocksBudget: 1 e " + std::to_string(n) + " threads diferem");
+}
+
+// ===== LzssDecoder: any chunking decodes like DecompressLZSS_PSX =====
+// Feeds `comp` cut at `cuts` (increasing offsets), draining every piece through an
+// output buffer of `out_cap` bytes, as a reader of a file or of disc sectors would.
+static std::vector<uint8_t> DecodeSplit(const std::vector<uint8_t>& comp, const std::vector<size_t>& cuts,
+                                        uint64_t limit, size_t out_cap) {
+    LzssDecoder dec(limit);
+    std::vector<uint8_t> result, buf(out_cap);
+    size_t start = 0;
+    auto piece = [&](size_t end) {
+        // Ends when the piece is used up and no match copy is pending, or at the limit.
+        for (;;) {
+            const auto p = dec.feed(comp.data() + start, end - start, buf.data(), buf.size());
+            result.insert(result.end(), buf.begin(), buf.begin() + p.produced);
+            start += p.consumed;
+            if (p.consumed == 0 && p.produced == 0) break;
+        }
+    };
+    for (size_t c : cuts) piece(std::max(c, start));
+    piece(comp.size());
+    if (dec.total_out() != result.size()) result.clear();
+    return result;
+}
+
+// Offsets that cut a stream right before and right after each flag byte, and
+// between the two bytes of each match token.
+static void TokenCuts(const std::vector<uint8_t>& comp, std::vector<size_t>& flag_cuts, std::vector<size_t>& match_cuts) {
+    size_t pos = 0;
+    while (pos < comp.size()) {
+        const uint8_t flags = comp[pos];
+        if (pos) flag_cuts.push_back(pos);
+        flag_cuts.push_back(++pos);
+        for (int bit = 0; bit < 8 && pos < comp.size(); ++bit) {
+            if (flags & (0x80 >> bit)) { match_cuts.push_back(pos + 1); pos += 2; }
+            else ++pos;
+        }
+    }
+}
+
+static std::vector<size_t> RandomCuts(std::mt19937& rng, size_t len) {
+    std::vector<size_t> cuts(len ? rng() % (len / 16 + 2) : 0);
+    for (auto& c : cuts) c = rng() % (len + 1);
+    std::sort(cuts.begin(), cuts.end());
+    return cuts;
+}
+
+static void TestDecoderChunks() {
+    std::mt19937 rng(0x4445434fu);
+    LzssParams otimo;
+    otimo.bucket_limit = 256;
+    otimo.max_candidates = 1024;
+    otimo.matcher = LzssMatcher::BinaryTree;
+    otimo.optimal_parse = true;
+    const size_t sizes[] = { 1, 17, 300, 5000, 40000 };
+
+    for (size_t size : sizes) {
+        for (int variant = 0; variant < 2; ++variant) {
+            const auto raw = MakeSample(rng, size);
+            const auto comp = CompressLZSS_PSX(raw, variant ? otimo : LzssParams());
+            const std::string what = "bloco de " + std::to_string(size) + (variant ? " (otimo)" : " (equilibrado)");
+            const auto ref = DecompressLZSS_PSX(comp, raw.size());
+            Check(ref == raw, what + ": DecompressLZSS_PSX não volta ao original");
+
+            std::vector<size_t> every(comp.size() ? comp.size() - 1 : 0);
+            for (size_t i = 0; i < every.size(); ++i) every[i] = i + 1;
+            std::vector<size_t> flag_cuts, match_cuts;
+            TokenCuts(comp, flag_cuts, match_cuts);
+
+            Check(DecodeSplit(comp, every, raw.size(), 4096) == ref, what + ": pedaços de 1 byte");
+            Check(DecodeSplit(comp, every, raw.size(), 1) == ref, what + ": pedaços de 1 byte, saída de 1 byte");
+            Check(DecodeSplit(comp, flag_cuts, raw.size(), 4096) == ref, what + ": cortes no byte de flags");
+            Check(DecodeSplit(comp, match_cuts, raw.size(), 4096) == ref, what + ": cortes no meio do match");
+            Check(DecodeSplit(comp, match_cuts, raw.size(), 7) == ref, what + ": cortes no meio do match, saída de 7 bytes");
+            for (int round = 0; round < 20; ++round) {
+                const auto cuts = RandomCuts(rng, comp.size());
+                const size_t cap = 1 + rng() % 300;
+                Check(DecodeSplit(comp, cuts, raw.size(), cap) == ref,
+                      what + ": " + std::to_string(cuts.size()) + " cortes aleatórios, saída de " + std::to_string(cap) + " bytes");
+            }
+            // Without a limit the trailing flag bits decide the end, as in DecompressLZSS_PSX.
+            Check(DecodeSplit(comp, RandomCuts(rng, comp.size()), 0, 1 + rng() % 300) == DecompressLZSS_PSX(comp),
+                  what + ": sem limite de saída");
+        }
+    }
+}
+
+// ===== Zero prefix: matches into the decoder's zeroed ring =====
+// Byte-at-a-time decoder written straight from the format, as the game does it:
+// ring of 4096 zeros, writing from 0xFEE.
+static std::vector<uint8_t> ReferenceDecode(const std::vector<uint8_t>& comp, size_t out_len) {
+    std::vector<uint8_t> ring(4096, 0), out;
+    size_t r = 0xFEE, src = 0;
+    while (out.size() < out_len && src < comp.size()) {
+        const uint8_t flags = comp[src++];
+        for (int bit = 0; bit < 8 && out.size() < out_len && src < comp.size(); ++bit) {
+            if ((flags & (0x80 >> bit)) == 0) {
+                out.push_back(ring[r] = comp[src++]);
+                r = (r + 1) & 0x0FFF;
+                continue;
+            }
+            if (src + 1 >= comp.size()) return {};
+            const uint8_t b1 = comp[src++], b2 = comp[src++];
+            const size_t off = ((size_t)(b2 & 0xF0) << 4) | b1;
+            for (size_t k = 0; k < (size_t)(b2 & 0x0F) + 3; ++k) {
+                out.push_back(ring[r] = ring[(off + k) & 0x0FFF]);
+                r = (r + 1) & 0x0FFF;
+            }
+        }
+    }
+    return out;
+}
+
+// Number of matches that start reading before the first output byte, and
+// whether the stream opens with a match.
+static size_t PrefixMatches(const std::vector<uint8_t>& comp, bool& first_is_match) {
+    size_t pos = 0, src = 0, count = 0;
+    first_is_match = comp.size() > 2 && (comp[0] & 0x80);
+    while (src < comp.size() && pos < 4096) {
+        const uint8_t flags = comp[src++];
+        for (int bit = 0; bit < 8 && src < comp.size(); ++bit) {
+            if ((flags & (0x80 >> bit)) == 0) { ++src; ++pos; continue; }
+            if (src + 1 >= comp.size()) return count;
+            const uint8_t b1 = comp[src++], b2 = comp[src++];
+            const size_t off = ((size_t)(b2 & 0xF0) << 4) | b1;
+            const size_t back = (0xFEE + pos - off) & 0x0FFF;
+            if ((back ? back : 4096) > pos) ++count;
+            pos += (size_t)(b2 & 0x0F) + 3;
+        }
+    }
+    return count;
+}
+
+static void TestZeroPrefix() {
+    std::mt19937 rng(0x5a45524fu);
+    struct Case { std::string name; std::vector<uint8_t> data; bool zero_start; };
+    std::vector<Case> inputs;
+    for (size_t zeros : { 3, 17, 18, 19, 36, 100, 4095, 4096, 4200, 6000 }) {
+        auto tail = MakeSample(rng, 2000);
+        tail[0] = 0x5A;                                   // the run ends exactly at `zeros`
+        std::vector<uint8_t> d(zeros, 0);
+        d.insert(d.end(), tail.begin(), tail.end());
+        inputs.push_back({ std::to_string(zeros) + " zeros + dados", d, true });
+    }
+    inputs.push_back({ "só zeros (40)", std::vector<uint8_t>(40, 0), true });
+    // Zeros right after a few literals still reach back into the prefix.
+    for (size_t lead : { 1, 2, 5, 17 }) {
+        std::vector<uint8_t> d;
+        for (size_t i = 0; i < lead; ++i) d.push_back((uint8_t)(0x11 * (i + 1)));
+        d.insert(d.end(), 30, 0);
+        const auto tail = MakeSample(rng, 500);
+        d.insert(d.end(), tail.begin(), tail.end());
+        inputs.push_back({ std::to_string(lead) + " literais + 30 zeros", d, false });
+    }
+
+    std::vector<std::pair<const char*, LzssParams>> profiles(5);
+    profiles[0] = { "equilibrado", LzssParams() };
+    profiles[1] = { "sem lazy", LzssParams() };
+    profiles[1].second.lazy_matching = false;
+    profiles[2] = { "maximo arvore", LzssParams() };
+    profiles[2].second.bucket_limit = 256;
+    profiles[2].second.max_candidates = 1024;
+    profiles[2].second.matcher = LzssMatcher::BinaryTree;
+    profiles[3] = { "otimo", profiles[2].second };
+    profiles[3].second.optimal_parse = true;
+    profiles[4] = { "otimo hash", profiles[3].second };
+    profiles[4].second.matcher = LzssMatcher::HashChain;
+
+    for (const auto& in : inputs) {
+        for (const auto& [pname, params] : profiles) {
+            const std::string what = in.name + " (" + pname + ")";
+            const auto comp = CompressLZSS_PSX(in.data, params);
+            Check(DecompressLZSS_PSX(comp, in.data.size()) == in.data, what + ": DecompressLZSS_PSX não volta ao original");
+            Check(ReferenceDecode(comp, in.data.size()) == in.data, what + ": decodificador de referência não volta ao original");
+            bool first_is_match = false;
+            Check(PrefixMatches(comp, first_is_match) > 0, what + ": nenhum match usa os zeros iniciais do anel");
+            if (in.zero_start) Check(first_is_match, what + ": o primeiro token não é match");
+
+            if (params.optimal_parse) continue;
+            // The streaming encoder sees the same prefix, whatever the chunking.
+            LzssEncoder enc(params);
+            std::vector<uint8_t> streamed;
+            for (size_t pos = 0; pos < in.data.size(); ) {
+                const size_t n = std::min<size_t>(1 + rng() % 700, in.data.size() - pos);
+                enc.write(in.data.data() + pos, n, streamed);
+                pos += n;
+            }
+            enc.finish(streamed);
+            Check(streamed == comp, what + ": LzssEncoder difere de CompressLZSS_PSX");
+        }
+    }
+
+    // The encoder slides its buffer every 32 KB; a long input fed in odd-sized
+    // chunks (single bytes, around the lookahead, across a whole slide) crosses
+    // that many times, with matches reaching back over each slide point.
+    std::vector<uint8_t> big(100, 0);
+    const auto body = MakeSample(rng, 160 << 10);
+    big.insert(big.end(), body.begin(), body.end());
+    const size_t chunks[] = { 1, 7, 38, 39, 40, 32771, 4099, 3, 65537, 511 };
+    for (const auto& [pname, params] : profiles) {
+        if (params.optimal_parse) continue;
+        const std::string what = std::string("160 KB em pedaços (") + pname + ")";
+        const auto comp = CompressLZSS_PSX(big, params);
+        Check(DecompressLZSS_PSX(comp, big.size()) == big, what + ": DecompressLZSS_PSX não volta ao original");
+        LzssEncoder enc(params);
+        std::vector<uint8_t> streamed;
+        size_t k = 0;
+        for (size_t pos = 0; pos < big.size(); ++k) {
+            const size_t n = std::min(chunks[k % std::size(chunks)], big.size() - pos);
+            enc.write(big.data() + pos, n, streamed);
+            pos += n;
+        }
+        enc.finish(streamed);
+        Check(streamed == comp, what + ": LzssEncoder difere de CompressLZSS_PSX");
+        Check(ReferenceDecode(streamed, big.size()) == big, what + ": saída do LzssEncoder não volta ao original");
+    }
+}
+
+// ===== Padding: exact sizes for in-place patching =====
+static void TestPadExact() {
+    std::mt19937 rng(0x50414453u);
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> inputs;
+    inputs.push_back({ "amostra", MakeSample(rng, 3000) });
+    inputs.push_back({ "zeros", std::vector<uint8_t>(2000, 0) });
+    inputs.push_back({ "35 zeros", std::vector<uint8_t>(35, 0) });   // two matches, 3 literals
+    std::vector<uint8_t> noise(1500);
+    for (auto& b : noise) b = (uint8_t)rng();
+    inputs.push_back({ "ruído", noise });
+
+    LzssParams optimal;
+    optimal.matcher = LzssMatcher::BinaryTree;
+    optimal.optimal_parse = true;
+    for (const auto& [name, raw] : inputs) {
+        for (const LzssParams& params : { LzssParams(), optimal }) {
+            const std::string what = name + (params.optimal_parse ? " (otimo)" : " (equilibrado)");
+            const auto comp = CompressLZSS_PSX(raw, params);
+            // Every byte a literal, plus an empty flag byte after a full last
+            // group: the largest stream. Some sizes well above the original
+            // have no encoding PadLZSS_PSX can reach, so only the first 64
+            // bytes of growth and the largest stream must work; any stream it
+            // does return must be right.
+            const size_t most = raw.size() + (raw.size() + 7) / 8 + (raw.size() % 8 == 0);
+            size_t wrong = 0, refused = 0;
+            for (size_t size = comp.size(); size <= most; ++size) {
+                auto padded = comp;
+                if (!PadLZSS_PSX(padded, raw, size)) {
+                    if (size == most || size <= comp.size() + 64) ++refused;
+                    continue;
+                }
+                if (padded.size() != size || DecompressLZSS_PSX(padded, raw.size()) != raw ||
+                    ReferenceDecode(padded, raw.size()) != raw)
+                    ++wrong;
+            }
+            Check(refused == 0, what + ": " + std::to_string(refused) + " tamanhos alcançáveis recusados");
+            Check(wrong == 0, what + ": " + std::to_string(wrong) + " preenchimentos com tamanho ou conteúdo errado");
+
+            for (size_t size : { comp.size() - 1, most + 1 }) {
+                auto padded = comp;
+                Check(!PadLZSS_PSX(padded, raw, size) && padded == comp,
+                      what + ": tamanho " + std::to_string(size) + " aceito ou stream alterado");
+            }
+        }
+    }
+
+    // PUD budget: blocks recompressed smaller than the template are padded
+    // back to its csize, so every header and payload stays where it was.
+    std::vector<std::vector<uint8_t>> blocks;
+    for (int i = 0; i < 4; ++i) blocks.push_back(MakeSample(rng, 2000 + rng() % 5000));
+    LzssParams weak;
+    weak.bucket_limit = 4;
+    weak.max_candidates = 4;
+    weak.lazy_matching = false;
+    const auto original = BuildPUD_FromBlocks(MakePudTemplate(blocks), blocks, true, weak, 1);
+    const PudFile tmpl = ParsePUD(original, "original.pud");
+    for (unsigned threads : { 1u, ManyThreads() }) {
+        const std::string what = "PUD com " + std::to_string(threads) + " threads";
+        PudBudgetReport rep;
+        const auto kept = BuildPUD_FromBlocksBudget(tmpl, blocks, {}, LzssAutoProfiles(), threads, nullptr, &rep);
+        Check(rep.all_fit && rep.offsets_kept, what + ": offsets não mantidos");
+        Check(kept.size() == original.size(), what + ": tamanho do PUD mudou");
+        const PudFile got = ParsePUD(kept, "kept.pud");
+        bool same_layout = got.blocks.size() == tmpl.blocks.size();
+        for (size_t i = 0; same_layout && i < got.blocks.size(); ++i)
+            same_layout = got.blocks[i].hdr_off == tmpl.blocks[i].hdr_off && got.blocks[i].data_off == tmpl.blocks[i].data_off &&
+                          got.blocks[i].csize == tmpl.blocks[i].csize;
+        Check(same_layout, what + ": cabeçalhos ou dados de bloco mudaram de lugar");
+        Check(PudDecodesTo(kept, blocks), what + ": blocos preenchidos não voltam ao original");
+        bool smaller = false;
+        for (size_t i = 0; i < rep.blocks.size(); ++i)
+            smaller = smaller || CompressLZSS_PSX(blocks[i], LzssParams()).size() < tmpl.blocks[i].csize;
+        Check(smaller, what + ": nenhum bloco precisou de preenchimento");
+
+        // A block that no longer fits its csize: packed back to back instead.
+        auto edited = blocks;
+        for (auto& b : edited[2]) b = (uint8_t)rng();
+        const auto moved = BuildPUD_FromBlocksBudget(tmpl, edited, {}, LzssAutoProfiles(), threads, nullptr, &rep);
+        Check(!rep.all_fit && !rep.offsets_kept, what + ": bloco maior que o csize marcado como mantido");
+        Check(PudDecodesTo(moved, edited), what + ": PUD reempacotado não volta aos blocos editados");
+    }
+}
+
+// ===== Disc images: pack an entry and write it back =====
+struct ImageFile {
+    std::string name;               // in DATA/
+    std::vector<uint8_t> data;
+};
+
+static void PutDirRecord(std::vector<uint8_t>& dir, const std::string& name, uint32_t lba, uint32_t size, bool is_dir) {
+    const size_t len = 33 + name.size() + (name.size() % 2 == 0);
+    std::vector<uint8_t> r(len, 0);
+    r[0] = (uint8_t)len;
+    for (int k = 0; k < 4; ++k) {
+        r[2 + k] = r[9 - k] = (uint8_t)(lba >> (8 * k));
+        r[10 + k] = r[17 - k] = (uint8_t)(size >> (8 * k));
+    }
+    r[25] = is_dir ? 2 : 0;
+    r[28] = r[31] = 1;
+    r[32] = (uint8_t)name.size();
+    std::memcpy(r.data() + 33, name.data(), name.size());
+    dir.insert(dir.end(), r.begin(), r.end());
+}
+
+// ISO9660 image with every file in DATA/: PVD at sector 16, root at 18, DATA
+// at 19, extents from 20. mode 0 writes a 2048-byte ISO; 1 and 2 write raw
+// 2352-byte sectors (Mode 2 as Form 1 data, EOR|EOF on each file's last
+// sector). EDC/ECC are left zero: only sectors a patch rewrites get them.
+static void WriteImage(const std::filesystem::path& path, int mode, const std::vector<ImageFile>& files) {
+    std::vector<uint32_t> lbas;
+    uint32_t lba = 20;
+    for (auto& f : files) {
+        lbas.push_back(lba);
+        lba += std::max<uint32_t>(1, (uint32_t)((f.data.size() + CD_SECTOR_DATA - 1) / CD_SECTOR_DATA));
+    }
+    std::vector<uint8_t> user((size_t)lba * CD_SECTOR_DATA, 0);
+    std::vector<uint8_t> root, data_dir;
+    PutDirRecord(root, std::string(1, '\0'), 18, CD_SECTOR_DATA, true);
+    PutDirRecord(root, std::string(1, '\1'), 18, CD_SECTOR_DATA, true);
+    PutDirRecord(root, "DATA", 19, CD_SECTOR_DATA, true);
+    PutDirRecord(data_dir, std::string(1, '\0'), 19, CD_SECTOR_DATA, true);
+    PutDirRecord(data_dir, std::string(1, '\1'), 18, CD_SECTOR_DATA, true);
+    for (size_t i = 0; i < files.size(); ++i) {
+        PutDirRecord(data_dir, files[i].name + ";1", lbas[i], (uint32_t)files[i].data.size(), false);
+        std::copy(files[i].data.begin(), files[i].data.end(), user.begin() + (size_t)lbas[i] * CD_SECTOR_DATA);
+    }
+    uint8_t* pvd = user.data() + 16 * CD_SECTOR_DATA;
+    pvd[0] = 1;
+    std::memcpy(pvd + 1, "CD001", 5);
+    pvd[6] = 1;
+    std::vector<uint8_t> root_rec;
+    PutDirRecord(root_rec, std::string(1, '\0'), 18, CD_SECTOR_DATA, true);
+    std::memcpy(pvd + 156, root_rec.data(), root_rec.size());
+    user[17 * CD_SECTOR_DATA] = 255;
+    std::memcpy(user.data() + 17 * CD_SECTOR_DATA + 1, "CD001", 5);
+    std::copy(root.begin(), root.end(), user.begin() + 18 * CD_SECTOR_DATA);
+    std::copy(data_dir.begin(), data_dir.end(), user.begin() + 19 * CD_SECTOR_DATA);
+
+    if (mode == 0) { WriteAllBytes(path, user); return; }
+    std::vector<uint8_t> raw((size_t)lba * CD_SECTOR_RAW, 0);
+    for (uint32_t i = 0; i < lba; ++i) {
+        uint8_t* s = raw.data() + (size_t)i * CD_SECTOR_RAW;
+        std::memset(s + 1, 0xFF, 10);
+        s[15] = (uint8_t)mode;
+        std::memcpy(s + (mode == 1 ? 16 : 24), user.data() + (size_t)i * CD_SECTOR_DATA, CD_SECTOR_DATA);
+        if (mode == 2) s[18] = s[22] = 0x08;
+    }
+    if (mode == 2)
+        for (size_t i = 0; i < files.size(); ++i) {
+            const uint32_t last = lbas[i] + (uint32_t)((std::max<size_t>(files[i].data.size(), 1) - 1) / CD_SECTOR_DATA);
+            raw[(size_t)last * CD_SECTOR_RAW + 18] = raw[(size_t)last * CD_SECTOR_RAW + 22] = 0x89;
+        }
+    WriteAllBytes(path, raw);
+}
+
+// Scratch folder for one test, removed when it goes out of scope.
+struct TempDir {
+    std::filesystem::path path;
+    explicit TempDir(const char* name) : path(std::filesystem::temp_directory_path() / name) {
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+    }
+    ~TempDir() { std::error_code ec; std::filesystem::remove_all(path, ec); }
+};
+
+// What ps1_cli pack --disco --gravar-disco does: read the PUD from the image,
+// rebuild it from edited blocks, let go of the image and write the file back.
+static void TestDiscPackBack() {
+    std::mt19937 rng(0x4241434bu);
+    std::vector<std::vector<uint8_t>> blocks;
+    for (int i = 0; i < 3; ++i) blocks.push_back(MakeSample(rng, 3000 + rng() % 6000));
+    const auto pud = BuildPUD_FromBlocks(MakePudTemplate(blocks), blocks, true, LzssParams(), 1);
+    const auto other = MakeSample(rng, 5000);
+
+    for (int mode = 0; mode <= 2; ++mode) {
+        const std::string what = mode ? "BIN Mode " + std::to_string(mode) : std::string("ISO");
+        TempDir tmp("lzss_test_pack_back");
+        const auto image = tmp.path / (mode ? "disco.bin" : "disco.iso");
+        WriteImage(image, mode, { { "P1.PUD", pud }, { "OUTRO.BIN", other } });
+
+        auto disc = std::make_shared<const DiscImage>(image);
+        const DiscEntry* e = disc->find("DATA/P1.PUD");
+        if (!e) { Check(false, what + ": DATA/P1.PUD não encontrado"); continue; }
+        const auto read = disc->open(*e).read_all();
+        Check(read == pud, what + ": PUD lido da imagem difere do gravado");
+
+        // The middle block becomes all zeros, so the new PUD is smaller.
+        auto edited = blocks;
+        std::fill(edited[1].begin(), edited[1].end(), 0);
+        const auto rebuilt = BuildPUD_FromBlocks(ParsePUD(read, e->path), edited, true, LzssParams(), 1);
+        Check(rebuilt.size() < pud.size(), what + ": PUD editado não ficou menor");
+        const std::string inside = e->path;
+        disc.reset();
+
+        const DiscPatchResult r = PatchDiscFile(image, inside, ByteView{ rebuilt.data(), rebuilt.size() }, 2);
+        Check(r.old_size == pud.size() && r.new_size == rebuilt.size(), what + ": tamanhos no resultado do patch");
+        const DiscImage after(image);
+        const DiscEntry* p = after.find(inside);
+        const DiscEntry* o = after.find("DATA/OUTRO.BIN");
+        Check(p && p->size == rebuilt.size(), what + ": registro de diretório sem o novo tamanho");
+        if (p) Check(after.open(*p).read_all() == rebuilt && PudDecodesTo(rebuilt, edited), what + ": PUD gravado não volta aos blocos editados");
+        Check(o && after.open(*o).read_all() == other, what + ": outro arquivo da imagem foi alterado");
+    }
+}
+
+// ===== PatchDiscFile: checksums, directory record, EOR/EOF, refusals =====
+// EDC and the P/Q ECC syndromes of a raw Mode 1 or Mode 2 Form 1 sector, from
+// ECMA-130 rather than from disc.cpp: all zero when the sector is consistent.
+static bool SectorChecksOut(const uint8_t* sector) {
+    static uint8_t exp[512], log[256];
+    if (!exp[0]) {
+        unsigned x = 1;
+        for (int i = 0; i < 255; ++i) {
+            exp[i] = (uint8_t)x; log[x] = (uint8_t)i;
+            x <<= 1;
+            if (x & 0x100) x ^= 0x11D;
+        }
+        for (int i = 255; i < 512; ++i) exp[i] = exp[i - 255];
+    }
+    auto mul = [&](uint8_t a, uint8_t b) { return a && b ? exp[log[a] + log[b]] : 0; };
+    auto edc = [](const uint8_t* p, size_t n) {
+        uint32_t c = 0;
+        for (size_t i = 0; i < n; ++i) {
+            c ^= p[i];
+            for (int k = 0; k < 8; ++k) c = (c >> 1) ^ ((c & 1) ? 0xD8018001u : 0);
+        }
+        return c;
+    };
+    auto u32 = [](const uint8_t* b) { return (uint32_t)(b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24)); };
+
+    uint8_t s[CD_SECTOR_RAW];
+    std::memcpy(s, sector, sizeof s);
+    if (s[15] == 2) {
+        if (u32(s + 0x818) != edc(s + 0x10, 0x808)) return false;
+        std::memset(s + 12, 0, 4);
+    } else if (u32(s + 0x810) != edc(s, 0x810)) {
+        return false;
+    }
+    const uint8_t* src = s + 12;
+    for (int m = 0; m < 86; ++m) {
+        uint8_t s0 = 0, s1 = 0;
+        for (int k = 0; k < 26; ++k) { const uint8_t v = src[m + 86 * k]; s0 ^= v; s1 ^= mul(exp[25 - k], v); }
+        if (s0 || s1) return false;
+    }
+    for (int m = 0; m < 52; ++m) {
+        uint8_t s0 = 0, s1 = 0;
+        int idx = (m >> 1) * 86 + (m & 1);
+        for (int k = 0; k < 45; ++k) {
+            const uint8_t v = k < 43 ? src[idx] : src[2236 + m + 52 * (k - 43)];
+            s0 ^= v; s1 ^= mul(exp[44 - k], v);
+            idx = (idx + 88) % 2236;
+        }
+        if (s0 || s1) return false;
+    }
+    return true;
+}
+
+static void TestDiscPatch() {
+    std::mt19937 rng(0x50415443u);
+    const auto file = MakeSample(rng, 5000);          // 3 sectors, room for 6144 bytes
+    const auto next = MakeSample(rng, 3000);
+
+    for (int mode = 0; mode <= 2; ++mode) {
+        const std::string name = mode ? "BIN Mode " + std::to_string(mode) : std::string("ISO");
+        const size_t sector_size = mode ? CD_SECTOR_RAW : CD_SECTOR_DATA;
+        const size_t user_offset = mode == 0 ? 0 : mode == 1 ? 16 : 24;
+        TempDir tmp("lzss_test_disc_patch");
+        const auto image = tmp.path / (mode ? "disco.bin" : "disco.iso");
+
+        // Patches DATA/F.BIN with `data` and checks everything PatchDiscFile promises.
+        auto patch = [&](const std::string& what_, std::vector<uint8_t> data) {
+            const std::string what = name + ", " + what_;
+            WriteImage(image, mode, { { "F.BIN", file }, { "G.BIN", next } });
+            const auto before = ReadAllBytes(image);
+            const DiscPatchResult r = PatchDiscFile(image, "DATA/F.BIN", ByteView{ data.data(), data.size() }, 2);
+            const auto after = ReadAllBytes(image);
+            const DiscImage disc(image);
+            const DiscEntry* f = disc.find("DATA/F.BIN");
+            const DiscEntry* g = disc.find("DATA/G.BIN");
+            if (!f || !g) { Check(false, what + ": arquivos sumiram da imagem"); return; }
+            Check(r.sectors == 3 && r.old_size == file.size() && r.new_size == data.size(), what + ": DiscPatchResult");
+            Check(disc.open(*f).read_all() == data, what + ": conteúdo novo");
+            Check(disc.open(*g).read_all() == next, what + ": o arquivo vizinho mudou");
+
+            // Both-endian size in the directory record.
+            const uint8_t* rec = disc.sector(f->record_lba) + user_offset + f->record_offset;
+            uint32_t le = 0, be = 0;
+            for (int k = 0; k < 4; ++k) { le |= (uint32_t)rec[10 + k] << (8 * k); be |= (uint32_t)rec[17 - k] << (8 * k); }
+            Check(le == data.size() && be == data.size(), what + ": tamanho no registro de diretório");
+
+            // Only rewritten sectors differ, and each of them checks out.
+            size_t rewritten = 0;
+            for (uint32_t lba = 0; lba < disc.sector_count(); ++lba) {
+                const size_t at = (size_t)lba * sector_size;
+                if (std::memcmp(before.data() + at, after.data() + at, sector_size) == 0) continue;
+                ++rewritten;
+                const bool ours = (lba >= f->lba && lba < f->lba + 3) || lba == f->record_lba;
+                Check(ours, what + ": setor " + std::to_string(lba) + " fora do arquivo foi alterado");
+                if (mode) Check(SectorChecksOut(after.data() + at), what + ": EDC/ECC do setor " + std::to_string(lba));
+            }
+            Check(rewritten == r.changed, what + ": setores alterados != changed");
+
+            // The file's new last sector carries EOR|EOF in both subheader copies, the others none.
+            if (mode == 2) {
+                const uint32_t last = (uint32_t)((std::max<size_t>(data.size(), 1) - 1) / CD_SECTOR_DATA);
+                for (uint32_t i = 0; i < 3; ++i) {
+                    const uint8_t* sh = disc.sector(f->lba + i) + 16;
+                    const uint8_t want = i == last ? 0x89 : 0x08;
+                    Check(sh[2] == want && sh[6] == want, what + ": submode do setor " + std::to_string(i) + " do arquivo");
+                }
+            }
+        };
+
+        auto larger = file;
+        larger.resize(6000, 0x5A);
+        patch("maior", larger);
+        auto smaller = file;
+        smaller.resize(1500);
+        patch("menor", smaller);
+        patch("igual", file);
+        auto edited = file;
+        edited[2100] ^= 0xFF;
+        patch("um byte", edited);
+
+        // Refusals leave the image as it was.
+        auto refused = [&](const std::string& what, const std::vector<uint8_t>& data) {
+            const auto before = ReadAllBytes(image);
+            bool threw = false;
+            try { PatchDiscFile(image, "DATA/F.BIN", ByteView{ data.data(), data.size() }, 2); }
+            catch (const std::exception&) { threw = true; }
+            Check(threw, name + ", " + what + ": não foi recusado");
+            Check(ReadAllBytes(image) == before, name + ", " + what + ": imagem alterada mesmo recusando");
+        };
+        WriteImage(image, mode, { { "F.BIN", file }, { "G.BIN", next } });
+        refused("maior que a extensão", std::vector<uint8_t>(3 * CD_SECTOR_DATA + 1, 1));
+        if (mode == 2) {
+            auto bin = ReadAllBytes(image);
+            bin[21 * CD_SECTOR_RAW + 18] |= 0x20;    // second sector of F.BIN becomes Form 2
+            WriteAllBytes(image, bin);
+            refused("setor Form 2", smaller);
+        }
+    }
+}
+
+// ===== GKO: incremental repack equals a full rebuild =====
+struct GkoItem {
+    std::string name;               // Latin-1, as in the TOC
+    std::vector<uint8_t> data;
+};
+
+// The archive layout written out by hand: count, 24-byte TOC entries, each entry
+// at the next `align` boundary, nothing after the last.
+static std::vector<uint8_t> BuildGkoReference(const std::vector<GkoItem>& items, size_t align) {
+    auto up = [&](size_t x) { return (x + align - 1) / align * align; };
+    size_t pos = up(4 + 24 * items.size()), end = pos;
+    std::vector<size_t> offsets;
+    for (auto& it : items) {
+        offsets.push_back(pos);
+        end = pos + it.data.size();
+        pos = up(end);
+    }
+    std::vector<uint8_t> out(end, 0);
+    auto w32 = [&](size_t at, size_t v) { for (int k = 0; k < 4; ++k) out[at + k] = (uint8_t)(v >> (8 * k)); };
+    w32(0, items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        std::memcpy(out.data() + 4 + 24 * i, items[i].name.data(), items[i].name.size());
+        w32(4 + 24 * i + 16, offsets[i]);
+        w32(4 + 24 * i + 20, items[i].data.size());
+        std::copy(items[i].data.begin(), items[i].data.end(), out.begin() + offsets[i]);
+    }
+    return out;
+}
+
+static void SetFile(const std::filesystem::path& p, const std::vector<uint8_t>& data) {
+    WriteAllBytes(p, data);
+    // A later write time than the one the index recorded, whatever the clock resolution.
+    std::filesystem::last_write_time(p, std::filesystem::last_write_time(p) + std::chrono::hours(1));
+}
+
+static void TestGkoRepack() {
+    std::mt19937 rng(0x474b4f31u);
+    const unsigned n = ManyThreads();
+    for (size_t align : { (size_t)0x800, (size_t)4 }) {
+        std::vector<GkoItem> items;
+        const char* names[] = { "F00.TIM", "F01.TIM", "CAF\xC9.TIM", "VAZIO.BIN", "SOM.VAB", "F05.TIM", "MAPA.DAT", "\xE7" "a.bin" };
+        for (const char* nm : names)
+            items.push_back({ nm, nm == std::string("VAZIO.BIN") ? std::vector<uint8_t>() : MakeSample(rng, 1 + rng() % 9000) });
+        items[1].data.resize(4001);                      // an odd size so align 4 is the detected alignment
+        const std::string what = "alinhamento " + std::to_string(align);
+        TempDir tmp("lzss_test_gko");
+        const auto original = BuildGkoReference(items, align);
+        WriteAllBytes(tmp.path / "A.GKO", original);
+
+        // Unpack as the front ends do.
+        GkoArchive ar = OpenGKO(tmp.path / "A.GKO");
+        Check(ar.entries.size() == items.size() && DetectGKOAlignment(ar.entries) == (int)align, what + ": TOC lido");
+        const auto folder = tmp.path / "A";
+        std::filesystem::create_directories(folder);
+        for (size_t i = 0; i < ar.entries.size() && i < items.size(); ++i) {
+            const auto& e = ar.entries[i];
+            Check(e.name == items[i].name && e.data.to_vector() == items[i].data, what + ": entrada " + std::to_string(i) + " lida");
+            WriteAllBytes(folder / GkoEntryFileName(e), e.data.data(), e.data.size());
+        }
+        WriteGKOFolderIndex(ar.entries, folder);
+
+        // Untouched folder: every entry reused without reading, bytes unchanged.
+        for (unsigned threads : { 1u, n }) {
+            const auto st = WriteGKO_Incremental(ar.entries, folder, tmp.path / "B.GKO", true, threads);
+            Check(ReadAllBytes(tmp.path / "B.GKO") == original, what + ": reempacotar sem mudanças altera o arquivo");
+            Check(st.reused == items.size() && st.by_mtime == items.size() && st.bytes_read == 0,
+                  what + ": sem mudanças, nem toda entrada veio do índice (" + std::to_string(threads) + " threads)");
+        }
+
+        // Edited in place (same size), resized, re-cased and found by stem only.
+        auto edited = items;
+        edited[0].data[edited[0].data.size() / 2] ^= 0x55;
+        SetFile(folder / "F00.TIM", edited[0].data);
+        edited[4].data = MakeSample(rng, 12345);
+        SetFile(folder / "SOM.VAB", edited[4].data);
+        std::filesystem::rename(folder / GkoEntryFileName(ar.entries[2]), folder / std::filesystem::u8path(u8"café.tim"));
+        std::filesystem::rename(folder / "F05.TIM", folder / "f05.bmp");
+        const auto expected = BuildGkoReference(edited, align);
+        for (bool trust : { true, false })
+            for (unsigned threads : { 1u, n }) {
+                const std::string how = what + (trust ? ", com índice, " : ", sem índice, ") + std::to_string(threads) + " threads";
+                const auto st = WriteGKO_Incremental(ar.entries, folder, tmp.path / "C.GKO", trust, threads);
+                Check(ReadAllBytes(tmp.path / "C.GKO") == expected, how + ": difere da montagem completa");
+                Check(st.replaced == 2 && st.reused == items.size() - 2, how + ": contagem de reaproveitadas/substituídas");
+            }
+
+        // A base archive other than the one the folder came from: an entry the
+        // index vouches for by size and write time differs in content, so the
+        // recorded hash must send it to the file.
+        auto other = items;
+        other[7].data[0] ^= 0xFF;
+        const auto other_bytes = BuildGkoReference(other, align);
+        const auto other_entries = ParseGKO(other_bytes);
+        WriteGKO_Incremental(other_entries, folder, tmp.path / "O.GKO", true, n);
+        Check(ReadAllBytes(tmp.path / "O.GKO") == expected, what + ": índice de outro GKO usado para reaproveitar entrada");
+
+        // Same size and the recorded write time: only a content compare sees the edit.
+        auto sneaky = edited;
+        sneaky[6].data[0] ^= 1;
+        const auto mtime = std::filesystem::last_write_time(folder / "MAPA.DAT");
+        WriteAllBytes(folder / "MAPA.DAT", sneaky[6].data);
+        std::filesystem::last_write_time(folder / "MAPA.DAT", mtime);
+        WriteGKO_Incremental(ar.entries, folder, tmp.path / "D.GKO", false, n);
+        Check(ReadAllBytes(tmp.path / "D.GKO") == BuildGkoReference(sneaky, align), what + ": sem índice, edição com a mesma data passou");
+
+#ifndef _WIN32
+        // Two files that fold to the same name (only possible on a case-sensitive
+        // file system) are refused.
+        WriteAllBytes(folder / "mapa.dat", sneaky[6].data);
+        bool threw = false;
+        try { WriteGKO_Incremental(ar.entries, folder, tmp.path / "E.GKO", true, n); }
+        catch (const std::exception&) { threw = true; }
+        Check(threw, what + ": MAPA.DAT e mapa.dat não foram recusados");
+#endif
+    }
+}
+
+// ===== Scanner: known streams at odd offsets =====
+struct Embedded {
+    size_t offset, comp, raw;
+    bool header;      // size_hint expected
+    bool exact_end;   // no header and random bytes after it: the end is a statistical guess
+};
+
+static std::string HitText(const LzssScanHit& h) {
+    return std::to_string(h.offset) + "+" + std::to_string(h.compressed) + "->" + std::to_string(h.decompressed);
+}
+
+static bool SameHits(const std::vector<LzssScanHit>& a, const std::vector<LzssScanHit>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (a[i].offset != b[i].offset || a[i].compressed != b[i].compressed || a[i].decompressed != b[i].decompressed ||
+            a[i].confidence != b[i].confidence || a[i].size_hint != b[i].size_hint)
+            return false;
+    return true;
+}
+
+static void TestScanStreams() {
+    for (uint32_t seed = 1; seed <= 6; ++seed) {
+        std::mt19937 rng(seed);
+        std::vector<uint8_t> img;
+        std::vector<Embedded> want;
+        auto noise = [&](size_t n) { for (size_t i = 0; i < n; ++i) img.push_back((uint8_t)rng()); };
+        auto put32 = [&](size_t v) { for (int k = 0; k < 4; ++k) img.push_back((uint8_t)(v >> (8 * k))); };
+        // header: 0 none, 1 u32 dsize, 2 u32 dsize + u32 csize (PUD block).
+        auto stream = [&](size_t n, int header, bool exact_end) {
+            auto raw = MakeSample(rng, n);
+            // MakeSample may open with hundreds of random bytes, which only a
+            // PUD header tells from noise; and a trailing zero literal cannot be
+            // told from zero padding after it.
+            for (size_t i = 0; i < 64; ++i) raw[i] = (uint8_t)(0x30 + i % 8);
+            raw.back() = 0x5A;
+            const auto comp = CompressLZSS_PSX(raw, LzssParams());
+            if (header >= 1) put32(raw.size());
+            if (header >= 2) put32(comp.size());
+            want.push_back({ img.size(), comp.size(), raw.size(), header > 0, exact_end });
+            img.insert(img.end(), comp.begin(), comp.end());
+        };
+        noise(12345);
+        stream(30000, 2, true);
+        noise(7777);
+        stream(20000, 0, true);     // zeros after it
+        img.insert(img.end(), 5001, 0);
+        stream(9000, 1, true);
+        noise(40001);
+        stream(25000, 0, false);    // ended by the CUSUM only
+        noise(3333);
+
+        const std::string what = "semente " + std::to_string(seed);
+        const auto hits = ScanLZSS_PSX(img.data(), img.size(), LzssScanOptions(), 1);
+        std::string got;
+        for (const auto& h : hits) got += " " + HitText(h);
+        Check(hits.size() == want.size(), what + ": " + std::to_string(want.size()) + " streams esperados, achados:" + got);
+        for (size_t i = 0; i < std::min(hits.size(), want.size()); ++i) {
+            const auto& h = hits[i];
+            const auto& w = want[i];
+            const std::string which = what + ", stream em " + std::to_string(w.offset) + ": achado " + HitText(h);
+            Check(h.offset == w.offset, which + " (offset)");
+            Check(h.size_hint == w.header, which + " (size_hint)");
+            if (w.exact_end) {
+                Check(h.compressed == w.comp && h.decompressed == w.raw,
+                      which + ", esperado " + std::to_string(w.comp) + "->" + std::to_string(w.raw));
+            } else {
+                // Random bytes keep decoding as plausible tokens for a little
+                // while, and the stream's last tokens may already look random.
+                const long dc = (long)h.compressed - (long)w.comp, dd = (long)h.decompressed - (long)w.raw;
+                Check(dc >= -16 && dc <= 24 && dd >= -64 && dd <= 64,
+                      which + ", fim longe de " + std::to_string(w.comp) + "->" + std::to_string(w.raw));
+            }
+        }
+
+        // Chunk boundaries fall inside every stream; each job finds the same
+        // candidates and the overlap merge keeps the same hits.
+        for (size_t chunk : { (size_t)4099, (size_t)777 }) {
+            for (unsigned threads : { 1u, ManyThreads() }) {
+                LzssScanOptions o;
+                o.chunk_size = chunk;
+                Check(SameHits(ScanLZSS_PSX(img.data(), img.size(), o, threads), hits),
+                      what + ": blocos de " + std::to_string(chunk) + " com " + std::to_string(threads) + " threads diferem");
+            }
+        }
+        Check(SameHits(ScanLZSS_PSX(img.data(), img.size(), LzssScanOptions(), ManyThreads()), hits),
+              what + ": 1 e " + std::to_string(ManyThreads()) + " threads diferem");
+    }
+
+    // Nothing to find: random bytes, zeros and uncompressed sample data.
+    std::mt19937 rng(0x4e4f4e45u);
+    std::vector<uint8_t> img;
+    for (int i = 0; i < 4; ++i) {
+        for (int k = 0; k < 60000; ++k) img.push_back((uint8_t)rng());
+        img.insert(img.end(), 3001 + i, 0);
+        const auto raw = MakeSample(rng, 40000);
+        img.insert(img.end(), raw.begin(), raw.end());
+    }
+    const auto none = ScanLZSS_PSX(img.data(), img.size(), LzssScanOptions(), ManyThreads());
+    std::string got;
+    for (const auto& h : none) got += " " + HitText(h);
+    Check(none.empty(), "dados sem streams, achados:" + got);
+}
+
+// ===== AtomicFileWriter: concurrent writers of one target =====
+static void TestAtomicWriters() {
+    TempDir tmp("lzss_test_atomic");
+    const auto target = tmp.path / "ALVO.PUD";
+    const unsigned n = ManyThreads();
+    std::vector<std::vector<uint8_t>> contents;
+    for (unsigned t = 0; t < n; ++t) contents.emplace_back((size_t)(256 + 64 * t) << 10, (uint8_t)(t + 1));
+
+    for (int round = 0; round < 3; ++round) {
+        const std::string what = "rodada " + std::to_string(round);
+        std::vector<int> errors(n, 0);
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < n; ++t)
+            threads.emplace_back([&, t]() {
+                try {
+                    WriteAllBytes(target, contents[t], (t & 1) != 0);
+                } catch (const std::exception&) {
+                    errors[t] = 1;
+                }
+            });
+        for (auto& th : threads) th.join();
+        Check(std::count(errors.begin(), errors.end(), 1) == 0, what + ": escrita concorrente falhou");
+        const auto got = ReadAllBytes(target);
+        Check(std::find(contents.begin(), contents.end(), got) != contents.end(),
+              what + ": arquivo final não é o de nenhum dos escritores");
+    }
+
+    // A writer dropped without commit() leaves the target as it was.
+    const auto before = ReadAllBytes(target);
+    {
+        AtomicFileWriter w(target, 4096);
+        const std::vector<uint8_t> junk(4096, 0xEE);
+        w.write(junk.data(), junk.size());
+    }
+    Check(ReadAllBytes(target) == before, "escritor sem commit alterou o arquivo");
+
+    size_t left = 0;
+    for (const auto& f : std::filesystem::directory_iterator(tmp.path)) left += f.path() != target;
+    Check(left == 0, "sobraram " + std::to_string(left) + " arquivos temporários");
+}
+
+// ===== Runner =====
+struct Test {
+    const char* name;
+    std::function<void()> run;
+};
+
+int main(int argc, char** argv) {
+    const std::vector<Test> tests = {
+        { "pud_threads", TestPudThreads },
+        { "decoder_chunks", TestDecoderChunks },
+        { "zero_prefix", TestZeroPrefix },
+        { "pad_exact", TestPadExact },
+        { "disc_pack_back", TestDiscPackBack },
+        { "disc_patch", TestDiscPatch },
+        { "scan_streams", TestScanStreams },
+        { "gko_repack", TestGkoRepack },
+        { "atomic_writers", TestAtomicWriters },
+    };
+    const std::string filter = argc > 1 ? argv[1] : "";
+    int ran = 0, failed = 0;
+    for (const auto& t : tests) {
+        if (!filter.empty() && std::string(t.name).find(filter) == std::string::npos) continue;
+        g_failures = 0;
+        std::printf("%s\n", t.name);
+        try {
+            t.run();
+        } catch (const std::exception& e) {
+            Check(false, std::string("exceção: ") + e.what());
+        }
+        ++ran;
+        if (g_failures) ++failed;
+    }
+    std::printf("%d testes, %d falharam\n", ran, failed);
+    return failed;
+}
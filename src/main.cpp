@@ -7,7 +7,6 @@
 #include <string>
 #include <vector>
 #include <filesystem>
-#include <fstream>
 #include <sstream>
 #include <array>
 #include <algorithm>
@@ -15,8 +14,10 @@
 
 // Inclua seus headers locais
 #include "lzss.h"
+#include "lzss_cache.h"
 #include "gko.h"
 #include "pud.h"
+#include "fileio.h"
 #include "../res/resource.h"
 
 #pragma comment(lib, "Comctl32.lib")
@@ -61,7 +62,7 @@ hPudProfile = nullptr, hPudLazy = nullptr, hPudPackRaw = nullptr, hPudPackComp =
 hPudProfileLabel = nullptr, hPudGroupExtract = nullptr, hPudGroupPack = nullptr;
 
 // Data state
-std::vector<GkoEntry> g_gkoEntries;
+GkoArchive g_gko;
 int g_gkoAlign = 1;
 std::vector<uint8_t> g_pudBytes;
 PudFile g_pud;
@@ -71,22 +72,6 @@ bool g_hasPud = false;
 HFONT g_hFontMono = nullptr;
 
 // ===== Helpers =====
-static std::vector<uint8_t> ReadAllBytes(const std::filesystem::path& p) {
-    std::ifstream f(p, std::ios::binary);
-    if (!f) throw std::runtime_error("Falha ao abrir: " + p.string());
-    f.seekg(0, std::ios::end);
-    size_t sz = (size_t)f.tellg();
-    f.seekg(0, std::ios::beg);
-    std::vector<uint8_t> buf(sz);
-    f.read((char*)buf.data(), sz);
-    return buf;
-}
-static void WriteAllBytes(const std::filesystem::path& p, const std::vector<uint8_t>& bytes) {
-    std::ofstream f(p, std::ios::binary);
-    if (!f) throw std::runtime_error("Falha ao salvar: " + p.string());
-    f.write((const char*)bytes.data(), bytes.size());
-}
-
 static void Log(const std::wstring& s) {
     int len = GetWindowTextLengthW(hLog);
     SendMessageW(hLog, EM_SETSEL, len, len);
@@ -272,22 +257,23 @@ static void OnOpenGKO() {
     auto p = OpenFileDlg(g_hWnd, L"GKO Files\0*.gko;*.GKO\0All Files\0*.*\0\0");
     if (p.empty()) return;
     try {
-        auto bytes = ReadAllBytes(p);
-        g_gkoEntries = ParseGKO(bytes);
-        g_gkoAlign = DetectGKOAlignment(g_gkoEntries);
+        // Owned copy rather than a mapping: the user may save a repack over this same file.
+        g_gko = OpenGKO(ReadAllBytes(p));
+        const auto& entries = g_gko.entries;
+        g_gkoAlign = DetectGKOAlignment(entries);
 
         std::wstringstream ss;
         auto fn = std::filesystem::path(p).filename().wstring();
         ss << L"GKO: " << fn
-            << L"\r\nEntradas: " << g_gkoEntries.size()
+            << L"\r\nEntradas: " << entries.size()
             << L"\r\nAlinhamento detectado: 0x" << std::hex << g_gkoAlign << std::dec
             << L"\r\n\r\n";
 
         ss << L"Idx  Tam(bytes)  Tam(hum)   Nome\r\n";
         ss << L"---- ----------  ---------  -----------------------------------------------\r\n";
 
-        for (size_t i = 0; i < g_gkoEntries.size(); ++i) {
-            const auto& e = g_gkoEntries[i];
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const auto& e = entries[i];
             const size_t sz = e.data.size();
             std::wstring wname = std::filesystem::path(std::wstring(e.name.begin(), e.name.end())).filename().wstring();
 
@@ -304,15 +290,17 @@ static void OnOpenGKO() {
 }
 
 static void OnUnpackGKO() {
-    if (g_gkoEntries.empty()) { MessageBoxW(g_hWnd, L"Abra um arquivo .GKO primeiro.", L"Informação", MB_ICONINFORMATION); return; }
+    if (g_gko.entries.empty()) { MessageBoxW(g_hWnd, L"Abra um arquivo .GKO primeiro.", L"Informação", MB_ICONINFORMATION); return; }
     auto folder = PickFolderModern(g_hWnd, L"Escolha a pasta de destino para extração");
     if (folder.empty()) return;
     try {
-        for (auto& e : g_gkoEntries) {
-            std::filesystem::path out = std::filesystem::path(folder) / std::filesystem::path(e.name).filename();
-            WriteAllBytes(out, e.data);
+        for (auto& e : g_gko.entries) {
+            std::filesystem::path out = std::filesystem::path(folder) / GkoEntryFileName(e);
+            WriteAllBytes(out, e.data.data(), e.data.size());
         }
-        std::wstringstream ss; ss << L"Extração concluída!\r\n\r\n" << g_gkoEntries.size() << L" arquivos extraídos para:\r\n" << folder;
+        // Lets a later repack from this folder skip the files left untouched.
+        WriteGKOFolderIndex(g_gko.entries, folder);
+        std::wstringstream ss; ss << L"Extração concluída!\r\n\r\n" << g_gko.entries.size() << L" arquivos extraídos para:\r\n" << folder;
         LogLn(L"[GKO] Extração concluída.");
         MessageBoxW(g_hWnd, ss.str().c_str(), L"Sucesso", MB_ICONINFORMATION);
     }
@@ -322,30 +310,35 @@ static void OnUnpackGKO() {
 static void OnPackGKO() {
     auto folder = PickFolderModern(g_hWnd, L"Escolha a pasta com os arquivos para reempacotar");
     if (folder.empty()) return;
-    auto order_entries = g_gkoEntries;
-    if (order_entries.empty()) {
+    GkoArchive tpl_archive;
+    const GkoArchive* order = &g_gko;
+    if (g_gko.entries.empty()) {
         auto tpl = OpenFileDlg(g_hWnd, L"GKO Files\0*.gko;*.GKO\0All Files\0*.*\0\0");
         if (tpl.empty()) {
             MessageBoxW(g_hWnd, L"É necessário selecionar um arquivo .GKO original para preservar a ordem.", L"Erro", MB_ICONERROR);
             return;
         }
         try {
-            auto b = ReadAllBytes(tpl);
-            order_entries = ParseGKO(b);
+            tpl_archive = OpenGKO(ReadAllBytes(tpl));
+            order = &tpl_archive;
             std::wstringstream ss; ss << L"Usando ordem do arquivo: " << std::filesystem::path(tpl).filename().c_str();
             LogLn(ss.str());
         }
         catch (const std::exception& e) { MessageBoxA(g_hWnd, e.what(), "Erro", MB_ICONERROR); return; }
     }
     try {
-        auto gko_bytes = BuildGKO_PreserveOrder(order_entries, folder);
         auto out = SaveFileDlg(g_hWnd, L"GKO Files\0*.gko\0All Files\0*.*\0\0", L"gko");
         if (out.empty()) return;
-        WriteAllBytes(out, gko_bytes);
+        GkoRepackStats st = WriteGKO_Incremental(order->entries, folder, std::filesystem::path(out), true, 0);
         std::wstringstream ss; ss << L"Arquivo GKO criado com sucesso!\r\n\r\nArquivo: "
             << std::filesystem::path(out).filename().c_str()
-            << L"\r\nItens: " << order_entries.size();
-        LogLn(L"[GKO] Empacotamento concluído.");
+            << L"\r\nItens: " << order->entries.size()
+            << L"\r\nReaproveitados do original: " << st.reused
+            << L"\r\nSubstituídos: " << st.replaced;
+        std::wstringstream lg; lg << L"[GKO] Empacotamento concluído: " << st.reused << L" entradas reaproveitadas ("
+            << st.by_mtime << L" sem leitura), " << st.replaced << L" substituídas; "
+            << HumanSize(st.bytes_read) << L" lidos da pasta, " << HumanSize(st.bytes_reused) << L" copiados do original.";
+        LogLn(lg.str());
         MessageBoxW(g_hWnd, ss.str().c_str(), L"Sucesso", MB_ICONINFORMATION);
     }
     catch (const std::exception& e) { MessageBoxA(g_hWnd, e.what(), "Erro", MB_ICONERROR); }
@@ -375,9 +368,8 @@ static void OnExtractPUD_Compressed() {
     try {
         auto stem = std::filesystem::path(g_pud.path).stem().wstring();
         for (auto& b : g_pud.blocks) {
-            std::vector<uint8_t> comp(g_pudBytes.begin() + b.data_off, g_pudBytes.begin() + b.data_end);
-            std::filesystem::path out = std::filesystem::path(outdir) / (stem + L".block" + std::to_wstring(b.idx) + L".bin");
-            WriteAllBytes(out, comp);
+            std::filesystem::path out = std::filesystem::path(outdir) / PudBlockFileName(stem, b.idx, false);
+            WriteAllBytes(out, g_pudBytes.data() + b.data_off, b.data_end - b.data_off);
         }
         std::wstringstream ss; ss << L"Extração de blocos comprimidos concluída!\r\n\r\n"
             << g_pud.blocks.size() << L" blocos extraídos para:\r\n" << outdir;
@@ -401,7 +393,7 @@ static void OnExtractPUD_Decompressed() {
                     << L" descomprimido com tamanho " << raw.size() << L" != dsize " << b.dsize;
                 LogLn(warn.str());
             }
-            std::filesystem::path out = std::filesystem::path(outdir) / (stem + L".block" + std::to_wstring(b.idx) + L".decomp.bin");
+            std::filesystem::path out = std::filesystem::path(outdir) / PudBlockFileName(stem, b.idx, true);
             WriteAllBytes(out, raw);
         }
         std::wstringstream ss; ss << L"Extração de blocos descomprimidos concluída!\r\n\r\n"
@@ -412,15 +404,29 @@ static void OnExtractPUD_Decompressed() {
     catch (const std::exception& e) { MessageBoxA(g_hWnd, e.what(), "Erro", MB_ICONERROR); }
 }
 
-static void GetCompressionParams(int& bucket_limit, int& max_candidates, bool& lazy) {
+// How OnPackPUD_FromRaw picks each block's compression.
+enum class PackMode {
+    Fixed,    // `params` for every block
+    Auto,     // race the profiles per block (CompressLZSS_Auto)
+    Budget,   // cheapest profile that fits the original csize, keeping offsets when all fit
+};
+
+static PackMode GetCompressionParams(LzssParams& params) {
     int idx = (int)SendMessageW(hPudProfile, CB_GETCURSEL, 0, 0);
     if (idx == CB_ERR) idx = 1; // default Equilibrado
-    lazy = (SendMessageW(hPudLazy, BM_GETCHECK, 0, 0) == BST_CHECKED);
+    params.lazy_matching = (SendMessageW(hPudLazy, BM_GETCHECK, 0, 0) == BST_CHECKED);
+    params.optimal_parse = false;
+    params.matcher = LzssMatcher::HashChain;
     switch (idx) {
-    case 0: bucket_limit = 64;  max_candidates = 128;  break;      // Rápido
-    case 2: bucket_limit = 256; max_candidates = 1024; break;      // Máxima compressão
-    default: bucket_limit = 128; max_candidates = 256; break;      // Equilibrado
+    case 0: params.bucket_limit = 64;  params.max_candidates = 128;  break;      // Rápido
+    case 2: params.bucket_limit = 256; params.max_candidates = 1024; break;      // Máxima compressão
+    case 3: params.bucket_limit = 256; params.max_candidates = 1024;             // Ótima (parse ótimo)
+            params.optimal_parse = true; params.matcher = LzssMatcher::BinaryTree; break;
+    default: params.bucket_limit = 128; params.max_candidates = 256; break;      // Equilibrado
     }
+    if (idx == 4) return PackMode::Auto;                                          // Automática
+    if (idx == 5) return PackMode::Budget;                                        // Caber no original
+    return PackMode::Fixed;
 }
 
 static bool CollectBlockFiles(std::vector<std::vector<uint8_t>>& outBlocks,
@@ -428,30 +434,7 @@ static bool CollectBlockFiles(std::vector<std::vector<uint8_t>>& outBlocks,
     const std::wstring& stem,
     bool use_raw) {
     if (!g_hasPud) return false;
-    outBlocks.clear();
-    try {
-        for (auto& blk : g_pud.blocks) {
-            std::wstring file1, file2;
-            if (use_raw) {
-                file1 = stem + L".block" + std::to_wstring(blk.idx) + L".decomp.bin";
-                file2 = L"block" + std::to_wstring(blk.idx) + L".decomp.bin";
-            }
-            else {
-                file1 = stem + L".block" + std::to_wstring(blk.idx) + L".bin";
-                file2 = L"block" + std::to_wstring(blk.idx) + L".bin";
-            }
-            std::filesystem::path p1 = folder / file1;
-            std::filesystem::path p2 = folder / file2;
-            if (std::filesystem::exists(p1)) outBlocks.push_back(ReadAllBytes(p1));
-            else if (std::filesystem::exists(p2)) outBlocks.push_back(ReadAllBytes(p2));
-            else {
-                std::wstringstream ss;
-                ss << L"Não foi encontrado arquivo para bloco " << blk.idx << L": esperado " << file1;
-                MessageBoxW(g_hWnd, ss.str().c_str(), L"Erro", MB_ICONERROR);
-                return false;
-            }
-        }
-    }
+    try { outBlocks = ReadPUDBlockFiles(g_pud, folder, stem, use_raw); }
     catch (const std::exception& e) { MessageBoxA(g_hWnd, e.what(), "Erro", MB_ICONERROR); return false; }
     return true;
 }
@@ -463,13 +446,82 @@ static void OnPackPUD_FromRaw() {
     std::vector<std::vector<uint8_t>> blocks;
     auto stem = std::filesystem::path(g_pud.path).stem().wstring();
     if (!CollectBlockFiles(blocks, folder, stem, true)) return;
-    int bl = 128, mc = 256; bool lazy = true;
-    GetCompressionParams(bl, mc, lazy);
+    LzssParams params;
+    PackMode mode = GetCompressionParams(params);
     try {
-        auto new_pud = BuildPUD_FromBlocks(g_pud, blocks, true, bl, mc, lazy);
+        LzssBlockCache cache(DefaultLzssCacheDir());
+        std::vector<uint8_t> new_pud;
+        if (mode == PackMode::Auto) {
+            LzssAutoOptions opt;
+            opt.profiles = LzssAutoProfiles(params.lazy_matching);
+            std::vector<LzssAutoResult> winners;
+            new_pud = BuildPUD_FromBlocksAuto(g_pud, blocks, opt, 0, &cache, &winners);
+            std::vector<int> count(opt.profiles.size(), 0);
+            for (size_t i = 0; i < winners.size(); ++i) {
+                const auto& w = winners[i];
+                ++count[w.winner];
+                std::wstringstream bl; bl << L"[PUD] Bloco " << g_pud.blocks[i].idx << L": "
+                    << std::filesystem::path(opt.profiles[w.winner].name).wstring() << L" ("
+                    << blocks[i].size() << L" -> " << w.data.size() << L" bytes, "
+                    << w.tried << L" perfis testados)";
+                LogLn(bl.str());
+            }
+            std::wstringstream al; al << L"[PUD] Automático:";
+            for (size_t p = 0; p < count.size(); ++p)
+                al << L" " << std::filesystem::path(opt.profiles[p].name).wstring() << L"=" << count[p];
+            LogLn(al.str());
+        } else if (mode == PackMode::Budget) {
+            auto profiles = LzssAutoProfiles(params.lazy_matching);
+            PudBudgetReport rep;
+            new_pud = BuildPUD_FromBlocksBudget(g_pud, blocks, {}, profiles, 0, &cache, &rep);
+            size_t overflow = 0;
+            for (size_t i = 0; i < rep.blocks.size(); ++i) {
+                const auto& r = rep.blocks[i];
+                std::wstringstream bl; bl << L"[PUD] Bloco " << g_pud.blocks[i].idx << L": ";
+                if (r.fits) bl << L"cabe (" << std::filesystem::path(profiles[r.profile].name).wstring();
+                else { bl << L"ESTOURO de " << (r.data.size() - r.budget) << L" bytes ("; ++overflow; }
+                bl << L", " << r.data.size() << L"/" << r.budget << L" bytes)";
+                LogLn(bl.str());
+            }
+            std::wstringstream sl; sl << L"[PUD] Orçamento: " << (rep.blocks.size() - overflow) << L"/"
+                << rep.blocks.size() << L" blocos cabem; "
+                << (rep.offsets_kept ? L"offsets originais mantidos." : L"blocos reempacotados em sequência.");
+            LogLn(sl.str());
+            if (overflow) {
+                std::wstringstream ws; ws << overflow << L" bloco(s) não cabem no tamanho original mesmo no perfil mais forte.\r\n"
+                    << L"O PUD pode ser salvo, mas os offsets mudam. Veja o log para detalhes.";
+                MessageBoxW(g_hWnd, ws.str().c_str(), L"Aviso", MB_ICONWARNING);
+            }
+        } else {
+            std::vector<LzssStats> stats;
+            new_pud = BuildPUD_FromBlocks(g_pud, blocks, true, params, 0, &cache, &stats);
+            LzssStats total;
+            for (size_t i = 0; i < stats.size(); ++i) {
+                const auto& st = stats[i];
+                total.add(st);
+                std::wstringstream bl; bl << L"[PUD] Bloco " << g_pud.blocks[i].idx << L": "
+                    << st.input_bytes << L" -> " << st.output_bytes << L" bytes, "
+                    << st.literals << L" literais, " << st.matches << L" matches, "
+                    << std::fixed << std::setprecision(1) << st.seconds * 1000.0 << L" ms";
+                LogLn(bl.str());
+            }
+            uint64_t covered = 0;
+            for (size_t k = 0; k < total.match_length.size(); ++k) covered += total.match_length[k] * (k + 3);
+            std::wstringstream tl; tl << L"[PUD] Total: " << total.literals << L" literais, " << total.matches
+                << L" matches (média " << std::fixed << std::setprecision(2)
+                << (total.matches ? (double)covered / total.matches : 0.0) << L" bytes), "
+                << total.candidates << L" candidatos em " << total.searches << L" buscas, "
+                << total.lazy_deferrals << L" adiamentos lazy";
+            LogLn(tl.str());
+        }
+        auto cs = cache.stats();
+        std::wstringstream cl; cl << L"[PUD] Cache LZSS: " << cs.hits << L"/" << (cs.hits + cs.misses)
+            << L" blocos reaproveitados (" << std::fixed << std::setprecision(1) << cs.hit_rate() * 100.0
+            << L"%), cache em disco: " << HumanSize(cs.stored_bytes);
+        LogLn(cl.str());
         auto out = SaveFileDlg(g_hWnd, L"PUD Files\0*.pud\0All Files\0*.*\0\0", L"pud");
         if (out.empty()) return;
-        WriteAllBytes(out, new_pud);
+        WriteAllBytes(out, new_pud, true);
         std::wstringstream ss;
         ss << L"Arquivo PUD criado com sucesso!\r\n\r\nArquivo: "
             << std::filesystem::path(out).filename().c_str()
@@ -491,7 +543,7 @@ static void OnPackPUD_FromComp() {
         auto new_pud = BuildPUD_FromBlocks(g_pud, blocks, false);
         auto out = SaveFileDlg(g_hWnd, L"PUD Files\0*.pud\0All Files\0*.*\0\0", L"pud");
         if (out.empty()) return;
-        WriteAllBytes(out, new_pud);
+        WriteAllBytes(out, new_pud, true);
         std::wstringstream ss;
         ss << L"Arquivo PUD criado com sucesso!\r\n\r\nArquivo: "
             << std::filesystem::path(out).filename().c_str()
@@ -556,6 +608,9 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
         SendMessageW(hPudProfile, CB_ADDSTRING, 0, (LPARAM)L"Rápido");
         SendMessageW(hPudProfile, CB_ADDSTRING, 0, (LPARAM)L"Equilibrado");
         SendMessageW(hPudProfile, CB_ADDSTRING, 0, (LPARAM)L"Máxima compressão");
+        SendMessageW(hPudProfile, CB_ADDSTRING, 0, (LPARAM)L"Ótima (parse ótimo, mais lento)");
+        SendMessageW(hPudProfile, CB_ADDSTRING, 0, (LPARAM)L"Automática (melhor perfil por bloco)");
+        SendMessageW(hPudProfile, CB_ADDSTRING, 0, (LPARAM)L"Caber no tamanho original (patch)");
         SendMessageW(hPudProfile, CB_SETCURSEL, 1, 0);
 
         hPudLazy = CreateWindowExW(0, L"BUTTON", L"Ativar Lazy Matching (melhor compressão)",
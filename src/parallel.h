@@ -0,0 +1,55 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Resolves a user thread count: 0 = one per hardware thread, never more than `jobs`.
+inline unsigned ResolveThreadCount(unsigned threads, size_t jobs) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    return (unsigned)std::max<size_t>(1, std::min<size_t>(threads, jobs));
+}
+
+// Runs fn(i) for every i in [0, count) on a pool of worker threads that pull
+// indices from a shared counter. With one thread everything runs inline on the
+// caller. The first exception thrown by any job stops the remaining jobs and
+// is rethrown on the caller's thread.
+template <class Fn>
+void ParallelFor(size_t count, unsigned threads, Fn&& fn) {
+    if (count == 0) return;
+    threads = ResolveThreadCount(threads, count);
+    if (threads == 1) {
+        for (size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&]() {
+        for (;;) {
+            if (failed.load(std::memory_order_relaxed)) return;
+            size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= count) return;
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& th : pool) th.join();
+    if (error) std::rethrow_exception(error);
+}
@@ -0,0 +1,611 @@
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "disc.h"
+#include "gko.h"
+#include "pud.h"
+#include "lzss.h"
+#include "lzss_auto.h"
+#include "lzss_cache.h"
+#include "cli_util.h"
+#include "fileio.h"
+#include "parallel.h"
+
+// Headless front end for the GUI's GKO and PUD operations. Every input file
+// produces one JSON object on its own line of stdout (JSON Lines), in input
+// order; failures are reported as {"file": ..., "error": ...} and the run
+// goes on with the next file.
+
+static void PrintUsage() {
+    std::cout << "MACROSS PS1 CLI (GKO/PUD)\n"
+              << "Uso:\n"
+              << "  ps1_cli gko list    <gko...>\n"
+              << "  ps1_cli gko verify  <gko...>\n"
+              << "  ps1_cli gko unpack  <gko...> [-o <pasta>]\n"
+              << "  ps1_cli gko pack    <gko_original...> -o <pasta_saida> [--dir <pasta>] [--comparar]\n"
+              << "  ps1_cli pud list    <pud...>\n"
+              << "  ps1_cli pud verify  <pud...>\n"
+              << "  ps1_cli pud extract     <pud...> [-o <pasta>]\n"
+              << "  ps1_cli pud extract-raw <pud...> [-o <pasta>]\n"
+              << "  ps1_cli pud pack-raw  <pud_template...> -o <pasta_saida> [--dir <pasta>] [-p <perfil>] [-m hash|arvore] [--no-lazy] [--alvo <R>] [--stats] [<cache>]\n"
+              << "  ps1_cli pud pack-comp <pud_template...> -o <pasta_saida> [--dir <pasta>]\n"
+              << "  ps1_cli disc list   <imagem.cue|bin|iso...>\n\n"
+              << "Entradas: arquivos, pastas (todos os .gko/.pud dentro) ou \"<pasta>/<glob>\".\n"
+              << "Com --disco <imagem.cue|bin|iso> as entradas são caminhos dentro da imagem (BIN Mode 2/2352\n"
+              << "ou ISO 2048), lidos direto do disco sem extrair; sem entradas, todos os .gko/.pud da imagem.\n"
+              << "Cada arquivo X usa a pasta <pasta>/<nome de X sem extensão>; sem -o (unpack/extract)\n"
+              << "ou --dir (pack), <pasta> é a pasta do próprio X (a atual, para X no disco).\n"
+              << "O pack grava <pasta_saida>/<nome de X>. Dentro da imagem o nome de X é o caminho inteiro\n"
+              << "com '/' trocado por '_' (DATA/A/X.PUD -> DATA_A_X.PUD); entradas com o mesmo nome são recusadas.\n\n"
+              << "Opções:\n"
+              << "  -j <N>       threads (padrão: todos os núcleos; com vários arquivos, um arquivo por thread)\n"
+              << "  -p <perfil>  rapido|equilibrado|maximo|otimo|auto|orcamento (padrão equilibrado);\n"
+              << "               orcamento = perfil mais barato que cabe no csize original, mantendo offsets\n"
+              << "  --alvo <R>   com auto, para no primeiro perfil com saída <= R * entrada\n"
+              << "  --stats      com perfil fixo, inclui estatísticas do codec (total e por bloco)\n"
+              << "  --comparar   gko pack: compara sempre o conteúdo, sem confiar no índice da pasta\n"
+              << "  --gravar-disco  pack com --disco: grava também o arquivo novo no lugar do original,\n"
+              << "               dentro da imagem (EDC/ECC só dos setores alterados); recusa se não couber\n"
+              << "  <cache>      --cache | --cache-dir <pasta> | --cache-mb <N> (veja lzss_cli)\n\n"
+              << "Saída: um objeto JSON por linha e por arquivo. Código de saída 5 se algum arquivo falhar.\n";
+}
+
+enum class PackMode { Fixed, Auto, Budget };
+
+struct Options {
+    std::filesystem::path out_dir;   // -o
+    std::filesystem::path src_dir;   // --dir
+    unsigned threads = 0;
+    LzssParams params;
+    PackMode mode = PackMode::Fixed;
+    double target_ratio = 0.0;
+    bool stats = false;
+    bool trust_mtime = true;
+    bool patch_disc = false;                    // --gravar-disco
+    CacheOptions cache;
+    LzssBlockCache* block_cache = nullptr;      // opened from `cache` for pack-raw
+    std::shared_ptr<const DiscImage> disc;      // --disco
+};
+
+// An input: a file on disk, or a file inside opt.disc.
+struct Source {
+    std::filesystem::path path;        // on disk, or the path inside the image
+    std::filesystem::path dir;         // default base for its work folder
+    const DiscEntry* entry = nullptr;  // set for files inside the image
+};
+
+// Files on disk are mapped; files in the image are read through its mapping.
+static SectorStream OpenSource(const Source& src, const Options& opt) {
+    if (src.entry) return opt.disc->open(*src.entry);
+    auto mapped = MapFile(src.path);
+    return SectorStream(ByteView{ mapped->data(), mapped->size() }, mapped);
+}
+
+// ===== Inputs =====
+static bool HasExtension(const std::filesystem::path& p, const char* ext) {
+    std::string e = PathU8(p.extension());
+    std::transform(e.begin(), e.end(), e.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return e == ext;
+}
+
+// Files named by `arg`: itself, the `ext` files in a folder, or a glob's matches (sorted).
+static void ExpandInput(const std::string& arg, const char* ext, std::vector<Source>& out) {
+    std::filesystem::path p = U8Path(arg);
+    std::vector<std::filesystem::path> found;
+    if (arg.find_first_of("*?") != std::string::npos) {
+        std::filesystem::path dir = p.parent_path();
+        if (dir.empty()) dir = ".";
+        std::string pat = PathU8(p.filename());
+        for (auto const& e : std::filesystem::directory_iterator(dir))
+            if (e.is_regular_file() && GlobMatch(pat.c_str(), PathU8(e.path().filename()).c_str()))
+                found.push_back(e.path());
+    } else if (std::filesystem::is_directory(p)) {
+        for (auto const& e : std::filesystem::directory_iterator(p))
+            if (e.is_regular_file() && HasExtension(e.path(), ext)) found.push_back(e.path());
+    } else {
+        found.push_back(p);
+    }
+    std::sort(found.begin(), found.end());
+    for (auto& f : found) out.push_back(Source{ f, f.parent_path() });
+}
+
+static std::string UpperAscii(std::string s) {
+    for (auto& c : s) c = (char)std::toupper((unsigned char)c);
+    return s;
+}
+
+// Inside the image `arg` is a file, a folder (its `ext` files) or a glob over
+// the whole path; an empty `arg` takes every `ext` file on the disc.
+static void ExpandDiscInput(const DiscImage& disc, const std::string& arg, const char* ext, std::vector<Source>& out) {
+    auto add = [&](const DiscEntry& e) { out.push_back(Source{ U8Path(e.path), {}, &e }); };
+    auto has_ext = [&](const DiscEntry& e) { return !e.is_dir && HasExtension(U8Path(e.path), ext); };
+    if (arg.empty()) {
+        for (auto& e : disc.entries()) if (has_ext(e)) add(e);
+        return;
+    }
+    if (arg.find_first_of("*?") != std::string::npos) {
+        std::string pat = UpperAscii(arg);
+        std::replace(pat.begin(), pat.end(), '\\', '/');
+        pat.erase(0, std::min(pat.find_first_not_of('/'), pat.size()));
+        size_t before = out.size();
+        for (auto& e : disc.entries())
+            if (!e.is_dir && GlobMatch(pat.c_str(), UpperAscii(e.path).c_str())) add(e);
+        if (out.size() == before) throw std::runtime_error("Nenhum arquivo da imagem corresponde a: " + arg);
+        return;
+    }
+    const DiscEntry* e = disc.find(arg);
+    if (!e) throw std::runtime_error("Arquivo não encontrado na imagem: " + arg);
+    if (!e->is_dir) { add(*e); return; }
+    const std::string prefix = UpperAscii(e->path) + "/";
+    for (auto& f : disc.entries())
+        if (has_ext(f) && UpperAscii(f.path).compare(0, prefix.size(), prefix) == 0 &&
+            f.path.find('/', prefix.size()) == std::string::npos)
+            add(f);
+}
+
+// Name of `src` in work folders and in -o. Files in the image use their whole
+// path, as lzss_cli scan does, so DATA/A/X.PUD and DATA/B/X.PUD stay apart.
+static std::filesystem::path LocalName(const Source& src) {
+    if (!src.entry) return src.path.filename();
+    std::string flat = src.entry->path;
+    std::replace(flat.begin(), flat.end(), '/', '_');
+    return U8Path(flat);
+}
+
+// Working folder of `src`: <base>/<stem>, base defaulting to src.dir.
+static std::filesystem::path FolderFor(const Source& src, const std::filesystem::path& base) {
+    return (base.empty() ? src.dir : base) / LocalName(src).stem();
+}
+
+static std::filesystem::path PackOutput(const Source& src, const Options& opt) {
+    std::filesystem::path out = opt.out_dir / LocalName(src);
+    // A file from the image must not land on the image itself.
+    const std::filesystem::path& in = src.entry ? opt.disc->bin_path() : src.path;
+    std::error_code ec;
+    if (std::filesystem::equivalent(in, out, ec))
+        throw std::runtime_error("A saída não pode sobrescrever o arquivo de entrada: " + PathU8(out));
+    return out;
+}
+
+// GKO names are Latin-1.
+static std::string Latin1ToUtf8(const std::string& s) {
+    std::string out;
+    for (unsigned char c : s) {
+        if (c < 0x80) out += (char)c;
+        else { out += (char)(0xC0 | (c >> 6)); out += (char)(0x80 | (c & 0x3F)); }
+    }
+    return out;
+}
+
+// ===== GKO =====
+static std::string GkoList(const Source& src, const Options& opt, unsigned) {
+    // Only the header and TOC are read.
+    SectorStream data = OpenSource(src, opt);
+    auto entries = ReadGKO_TOC(data);
+    std::string j = "{\"file\": " + JsonString(src.path) + ", \"type\": \"gko\", \"alignment\": "
+                  + std::to_string(DetectGKOAlignment(entries)) + ", \"entries\": [";
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& e = entries[i];
+        j += (i ? ", " : "") + std::string("{\"index\": ") + std::to_string(i)
+           + ", \"name\": " + JsonString(Latin1ToUtf8(e.name))
+           + ", \"offset\": " + std::to_string(e.offset) + ", \"size\": " + std::to_string(e.size) + "}";
+    }
+    return j + "]}";
+}
+
+// Entries must lie after the TOC and must not overlap.
+static std::string GkoVerify(const Source& src, const Options& opt, unsigned) {
+    SectorStream data = OpenSource(src, opt);
+    auto entries = ReadGKO_TOC(data);
+    std::vector<size_t> order(entries.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return entries[a].offset < entries[b].offset; });
+    uint64_t end = 4 + (uint64_t)entries.size() * 24;
+    size_t prev = SIZE_MAX;
+    for (size_t i : order) {
+        const auto& e = entries[i];
+        if (e.size > 0 && e.offset < end)
+            throw std::runtime_error("Entrada " + std::to_string(i) + " (" + e.name + ") sobrepõe "
+                                     + (prev == SIZE_MAX ? std::string("o TOC") : "a entrada " + std::to_string(prev)));
+        if (e.size > 0) { end = (uint64_t)e.offset + e.size; prev = i; }
+    }
+    return "{\"file\": " + JsonString(src.path) + ", \"entries\": " + std::to_string(entries.size())
+         + ", \"alignment\": " + std::to_string(DetectGKOAlignment(entries)) + ", \"ok\": true}";
+}
+
+static std::string GkoUnpack(const Source& src, const Options& opt, unsigned) {
+    GkoArchive ar = OpenGKO(OpenSource(src, opt));
+    std::filesystem::path folder = FolderFor(src, opt.out_dir);
+    std::filesystem::create_directories(folder);
+    uint64_t bytes = 0;
+    for (auto& e : ar.entries) {
+        WriteAllBytes(folder / GkoEntryFileName(e), e.data.data(), e.data.size());
+        bytes += e.data.size();
+    }
+    // Lets a later pack from this folder skip the files left untouched.
+    WriteGKOFolderIndex(ar.entries, folder);
+    return "{\"file\": " + JsonString(src.path) + ", \"folder\": " + JsonString(folder)
+         + ", \"entries\": " + std::to_string(ar.entries.size()) + ", \"bytes\": " + std::to_string(bytes) + "}";
+}
+
+static std::string GkoPack(const Source& src, const Options& opt, unsigned threads) {
+    GkoArchive base = OpenGKO(OpenSource(src, opt));
+    std::filesystem::path folder = FolderFor(src, opt.src_dir);
+    std::filesystem::path out = PackOutput(src, opt);
+    GkoRepackStats st = WriteGKO_Incremental(base.entries, folder, out, opt.trust_mtime, threads);
+    return "{\"file\": " + JsonString(src.path) + ", \"folder\": " + JsonString(folder) + ", \"output\": " + JsonString(out)
+         + ", \"size\": " + std::to_string(std::filesystem::file_size(out))
+         + ", \"entries\": " + std::to_string(base.entries.size())
+         + ", \"reused\": " + std::to_string(st.reused) + ", \"replaced\": " + std::to_string(st.replaced)
+         + ", \"by_mtime\": " + std::to_string(st.by_mtime)
+         + ", \"bytes_read\": " + std::to_string(st.bytes_read)
+         + ", \"bytes_reused\": " + std::to_string(st.bytes_reused) + "}";
+}
+
+// ===== PUD =====
+// Block payloads are read through the stream as they are needed.
+static PudFile LoadPUD(const Source& src, const Options& opt, SectorStream& data) {
+    data = OpenSource(src, opt);
+    return ParsePUD(data, PathU8(src.path.filename()));
+}
+
+// Decompresses block `b`, feeding the decoder straight from the stream's pieces.
+static std::vector<uint8_t> DecodeBlock(const SectorStream& data, const PudBlock& b) {
+    if (b.dsize == 0) return DecompressLZSS_PSX(data.read(b.data_off, b.csize), 0);
+    std::vector<uint8_t> out(b.dsize);
+    LzssDecoder dec(b.dsize);
+    size_t produced = 0;
+    data.for_each_chunk(b.data_off, b.csize, [&](const uint8_t* p, size_t n) {
+        while (n > 0 && !dec.finished()) {
+            auto prog = dec.feed(p, n, out.data() + produced, out.size() - produced);
+            p += prog.consumed; n -= prog.consumed; produced += prog.produced;
+            if (prog.consumed == 0 && prog.produced == 0) break;
+        }
+    });
+    out.resize(produced);
+    return out;
+}
+
+static std::string PudList(const Source& src, const Options& opt, unsigned) {
+    SectorStream data;
+    PudFile pud = LoadPUD(src, opt, data);
+    std::string j = "{\"file\": " + JsonString(src.path) + ", \"type\": \"pud\", \"size\": " + std::to_string(pud.size)
+                  + ", \"blocks\": [";
+    for (size_t i = 0; i < pud.blocks.size(); ++i) {
+        const auto& b = pud.blocks[i];
+        char buf[256];
+        std::snprintf(buf, sizeof(buf),
+            "%s{\"index\": %d, \"header_offset\": %u, \"width\": %u, \"height\": %u, \"unknown\": [%u, %u, %u, %u], "
+            "\"dsize\": %u, \"csize\": %u, \"data_offset\": %u}",
+            i ? ", " : "", b.idx, b.hdr_off, b.w, b.h, b.u1, b.u2, b.u3, b.u4, b.dsize, b.csize, b.data_off);
+        j += buf;
+    }
+    return j + "]}";
+}
+
+// Every block must decompress to exactly its dsize.
+static std::string PudVerify(const Source& src, const Options& opt, unsigned threads) {
+    SectorStream data;
+    PudFile pud = LoadPUD(src, opt, data);
+    std::vector<size_t> sizes(pud.blocks.size());
+    ParallelFor(pud.blocks.size(), threads, [&](size_t i) { sizes[i] = DecodeBlock(data, pud.blocks[i]).size(); });
+    std::string bad;
+    uint64_t total = 0;
+    for (size_t i = 0; i < pud.blocks.size(); ++i) {
+        total += sizes[i];
+        if (sizes[i] != pud.blocks[i].dsize)
+            bad += (bad.empty() ? "" : ", ") + std::to_string(pud.blocks[i].idx) + " (" + std::to_string(sizes[i])
+                 + " de " + std::to_string(pud.blocks[i].dsize) + " bytes)";
+    }
+    if (!bad.empty()) throw std::runtime_error("Blocos que não descomprimem para o dsize: " + bad);
+    return "{\"file\": " + JsonString(src.path) + ", \"blocks\": " + std::to_string(pud.blocks.size())
+         + ", \"bytes\": " + std::to_string(total) + ", \"ok\": true}";
+}
+
+// Compressed payloads as stored, or (raw) decompressed to dsize on `threads` workers.
+static std::string PudExtractWith(const Source& src, const Options& opt, unsigned threads, bool raw) {
+    SectorStream data;
+    PudFile pud = LoadPUD(src, opt, data);
+    std::filesystem::path folder = FolderFor(src, opt.out_dir);
+    std::filesystem::create_directories(folder);
+    const std::filesystem::path stem = src.path.stem();
+    std::vector<size_t> sizes(pud.blocks.size());
+    ParallelFor(pud.blocks.size(), raw ? threads : 1, [&](size_t i) {
+        const auto& b = pud.blocks[i];
+        std::filesystem::path out = folder / PudBlockFileName(stem, b.idx, raw);
+        if (!raw) {
+            WriteStreamRange(out, data, b.data_off, b.csize);
+            sizes[i] = b.csize;
+            return;
+        }
+        auto block = DecodeBlock(data, b);
+        WriteAllBytes(out, block);
+        sizes[i] = block.size();
+    });
+    std::string mismatch;
+    uint64_t total = 0;
+    for (size_t i = 0; i < pud.blocks.size(); ++i) {
+        total += sizes[i];
+        if (raw && sizes[i] != pud.blocks[i].dsize)
+            mismatch += (mismatch.empty() ? "" : ", ") + std::to_string(pud.blocks[i].idx);
+    }
+    std::string j = "{\"file\": " + JsonString(src.path) + ", \"folder\": " + JsonString(folder)
+                  + ", \"blocks\": " + std::to_string(pud.blocks.size()) + ", \"bytes\": " + std::to_string(total);
+    if (raw) j += ", \"dsize_mismatch\": [" + mismatch + "]";
+    return j + "}";
+}
+
+static std::string PudExtract(const Source& src, const Options& opt, unsigned threads) {
+    return PudExtractWith(src, opt, threads, false);
+}
+static std::string PudExtractRaw(const Source& src, const Options& opt, unsigned threads) {
+    return PudExtractWith(src, opt, threads, true);
+}
+
+static std::string PudPackWith(const Source& src, const Options& opt, unsigned threads, bool raw) {
+    SectorStream data;
+    PudFile pud = LoadPUD(src, opt, data);
+    std::filesystem::path folder = FolderFor(src, opt.src_dir);
+    std::filesystem::path out = PackOutput(src, opt);
+    auto blocks = ReadPUDBlockFiles(pud, folder, src.path.stem(), raw);
+    LzssBlockCache* cache = opt.block_cache;
+
+    // Per-block JSON members after index/raw size, filled in by the chosen mode.
+    std::vector<std::string> extra(blocks.size());
+    std::string summary;
+    std::vector<uint8_t> new_pud;
+    if (!raw) {
+        new_pud = BuildPUD_FromBlocks(pud, blocks, false);
+    } else if (opt.mode == PackMode::Auto) {
+        LzssAutoOptions ao;
+        ao.profiles = LzssAutoProfiles(opt.params.lazy_matching);
+        ao.target_ratio = opt.target_ratio;
+        std::vector<LzssAutoResult> winners;
+        new_pud = BuildPUD_FromBlocksAuto(pud, blocks, ao, threads, cache, &winners);
+        for (size_t i = 0; i < winners.size(); ++i)
+            extra[i] = ", \"compressed\": " + std::to_string(winners[i].data.size())
+                     + ", \"profile\": " + JsonString(ao.profiles[winners[i].winner].name)
+                     + ", \"tried\": " + std::to_string(winners[i].tried);
+        summary = ", \"mode\": \"auto\"";
+    } else if (opt.mode == PackMode::Budget) {
+        auto profiles = LzssAutoProfiles(opt.params.lazy_matching);
+        PudBudgetReport rep;
+        new_pud = BuildPUD_FromBlocksBudget(pud, blocks, {}, profiles, threads, cache, &rep);
+        for (size_t i = 0; i < rep.blocks.size(); ++i) {
+            const auto& r = rep.blocks[i];
+            extra[i] = ", \"compressed\": " + std::to_string(r.data.size()) + ", \"budget\": " + std::to_string(r.budget)
+                     + ", \"fits\": " + (r.fits ? "true" : "false")
+                     + ", \"profile\": " + JsonString(profiles[r.profile].name);
+        }
+        summary = std::string(", \"mode\": \"budget\", \"all_fit\": ") + (rep.all_fit ? "true" : "false")
+                + ", \"offsets_kept\": " + (rep.offsets_kept ? "true" : "false");
+    } else {
+        std::vector<LzssStats> stats;
+        new_pud = BuildPUD_FromBlocks(pud, blocks, true, opt.params, threads, cache, opt.stats ? &stats : nullptr);
+        LzssStats total;
+        for (size_t i = 0; i < stats.size(); ++i) {
+            total.add(stats[i]);
+            extra[i] = ", \"stats\": {" + StatsJsonFields(stats[i]) + "}";
+        }
+        summary = ", \"mode\": \"fixed\"";
+        if (opt.stats) summary += ", \"stats\": {" + StatsJsonFields(total) + "}";
+    }
+    WriteAllBytes(out, new_pud, true);
+
+    std::string j = "{\"file\": " + JsonString(src.path) + ", \"folder\": " + JsonString(folder) + ", \"output\": "
+                  + JsonString(out) + ", \"size\": " + std::to_string(new_pud.size()) + summary + ", \"blocks\": [";
+    for (size_t i = 0; i < blocks.size(); ++i)
+        j += (i ? ", " : "") + std::string("{\"index\": ") + std::to_string(pud.blocks[i].idx)
+           + ", \"input\": " + std::to_string(blocks[i].size()) + extra[i] + "}";
+    return j + "]}";
+}
+
+static std::string PudPackRaw(const Source& src, const Options& opt, unsigned threads) {
+    return PudPackWith(src, opt, threads, true);
+}
+static std::string PudPackComp(const Source& src, const Options& opt, unsigned threads) {
+    return PudPackWith(src, opt, threads, false);
+}
+
+// ===== Disc images =====
+static std::string DiscList(const Source& src, const Options&, unsigned) {
+    DiscImage disc(src.path);
+    std::string j = "{\"file\": " + JsonString(src.path) + ", \"bin\": " + JsonString(disc.bin_path())
+                  + ", \"sector_size\": " + std::to_string(disc.sector_size()) + ", \"mode\": " + std::to_string(disc.mode())
+                  + ", \"sectors\": " + std::to_string(disc.sector_count()) + ", \"entries\": [";
+    for (size_t i = 0; i < disc.entries().size(); ++i) {
+        const auto& e = disc.entries()[i];
+        j += (i ? ", " : "") + std::string("{\"path\": ") + JsonString(e.path) + ", \"lba\": " + std::to_string(e.lba)
+           + ", \"size\": " + std::to_string(e.size) + (e.is_dir ? ", \"dir\": true}" : "}");
+    }
+    return j + "]}";
+}
+
+// ===== Driver =====
+using Op = std::string (*)(const Source&, const Options&, unsigned);
+
+struct Command {
+    const char* kind;
+    const char* name;
+    Op op;
+    bool pack;      // writes to -o, reads block files from --dir
+    bool unpack;    // writes a work folder under -o
+};
+
+static const Command COMMANDS[] = {
+    { "gko",  "list",        GkoList,       false, false },
+    { "gko",  "verify",      GkoVerify,     false, false },
+    { "gko",  "unpack",      GkoUnpack,     false, true  },
+    { "gko",  "pack",        GkoPack,       true,  false },
+    { "pud",  "list",        PudList,       false, false },
+    { "pud",  "verify",      PudVerify,     false, false },
+    { "pud",  "extract",     PudExtract,    false, true  },
+    { "pud",  "extract-raw", PudExtractRaw, false, true  },
+    { "pud",  "pack-raw",    PudPackRaw,    true,  false },
+    { "pud",  "pack-comp",   PudPackComp,   true,  false },
+    { "disc", "list",        DiscList,      false, false },
+};
+
+static int RunCli(const Args& args) {
+    const bool help = args.size() > 1 && (args[1] == "-h" || args[1] == "--help");
+    if (args.size() < 3 || help) { PrintUsage(); return help ? 0 : 1; }
+    const Command* cmd = nullptr;
+    for (auto& c : COMMANDS)
+        if (args[1] == c.kind && args[2] == c.name) cmd = &c;
+    if (!cmd) { PrintUsage(); return 1; }
+    const std::string kind = cmd->kind;
+
+    Options opt;
+    std::vector<std::string> inputs;
+    std::filesystem::path disc_path;
+    bool auto_profile = false;
+    for (size_t i = 3; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        if (ParseCacheOption(args, i, opt.cache)) continue;
+        if ((a == "-o" || a == "--out") && i + 1 < args.size()) opt.out_dir = U8Path(args[++i]);
+        else if (a == "--dir" && i + 1 < args.size()) opt.src_dir = U8Path(args[++i]);
+        else if (a == "--disco" && i + 1 < args.size()) disc_path = U8Path(args[++i]);
+        else if ((a == "-j" || a == "--jobs") && i + 1 < args.size()) opt.threads = (unsigned)std::strtoul(args[++i].c_str(), nullptr, 10);
+        else if (a == "-p" && i + 1 < args.size()) {
+            const std::string& p = args[++i];
+            if (p == "orcamento" || p == "orçamento") opt.mode = PackMode::Budget;
+            else if (ApplyProfileOrAuto(p, opt.params, auto_profile)) opt.mode = auto_profile ? PackMode::Auto : PackMode::Fixed;
+            else { std::cerr << "Perfil inválido: " << p << "\n"; return 1; }
+        }
+        else if (a == "-m" && i + 1 < args.size()) {
+            if (!ApplyMatcher(args[++i], opt.params)) { std::cerr << "Busca inválida: " << args[i] << "\n"; return 1; }
+        }
+        else if (a == "--alvo" && i + 1 < args.size()) opt.target_ratio = std::strtod(args[++i].c_str(), nullptr);
+        else if (a == "--no-lazy") opt.params.lazy_matching = false;
+        else if (a == "--stats") opt.stats = true;
+        else if (a == "--comparar") opt.trust_mtime = false;
+        else if (a == "--gravar-disco") opt.patch_disc = true;
+        else if (!a.empty() && a[0] == '-') { std::cerr << "Opção desconhecida: " << a << "\n"; return 1; }
+        else inputs.push_back(a);
+    }
+    if (cmd->pack && opt.out_dir.empty()) { std::cerr << "Informe a pasta de saída com -o.\n"; return 1; }
+    if (opt.stats && (cmd->op != PudPackRaw || opt.mode != PackMode::Fixed)) {
+        std::cerr << "--stats vale apenas para pud pack-raw com perfil fixo.\n";
+        return 1;
+    }
+    if (opt.patch_disc && (!cmd->pack || disc_path.empty())) {
+        std::cerr << "--gravar-disco vale apenas para os comandos pack com --disco.\n";
+        return 1;
+    }
+    if (kind == "disc" && !disc_path.empty()) { std::cerr << "disc list recebe as imagens como entradas.\n"; return 1; }
+
+    std::vector<Source> files;
+    std::unique_ptr<LzssBlockCache> cache;
+    try {
+        const char* ext = kind == "gko" ? ".gko" : kind == "pud" ? ".pud" : "";
+        if (!disc_path.empty()) {
+            opt.disc = std::make_shared<const DiscImage>(disc_path);
+            if (inputs.empty()) ExpandDiscInput(*opt.disc, "", ext, files);
+            for (auto& in : inputs) ExpandDiscInput(*opt.disc, in, ext, files);
+        } else {
+            for (auto& in : inputs) ExpandInput(in, ext, files);
+        }
+        if (cmd->pack) std::filesystem::create_directories(opt.out_dir);
+        if (cmd->op == PudPackRaw) cache = OpenCache(opt.cache);
+        opt.block_cache = cache.get();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+    if (files.empty()) { std::cerr << "Nenhum arquivo de entrada.\n"; return 2; }
+    // Two inputs with the same name would overwrite each other's folder or output.
+    if (cmd->pack || cmd->unpack) {
+        std::map<std::filesystem::path, size_t> seen;
+        for (size_t i = 0; i < files.size(); ++i) {
+            const auto target = (cmd->pack ? opt.out_dir / LocalName(files[i]) : FolderFor(files[i], opt.out_dir)).lexically_normal();
+            auto [it, fresh] = seen.emplace(target, i);
+            if (!fresh) {
+                std::cerr << "Duas entradas gravariam em " << PathU8(target) << ": " << PathU8(files[it->second].path)
+                          << " e " << PathU8(files[i].path) << "\n";
+                return 2;
+            }
+        }
+    }
+
+    // Several files run one per thread, each single-threaded inside; a single
+    // file gets all the threads for its blocks.
+    const bool many = files.size() > 1;
+    const unsigned inner = many ? 1 : opt.threads;
+    std::vector<std::string> lines(files.size());
+    std::vector<char> done(files.size(), 0), packed(files.size(), 0);
+    size_t next_print = 0, failed = 0;
+    std::mutex print_mutex;
+    ParallelFor(files.size(), many ? opt.threads : 1, [&](size_t i) {
+        std::string line;
+        bool ok = true;
+        try {
+            line = cmd->op(files[i], opt, inner);
+        } catch (const std::exception& e) {
+            line = "{\"file\": " + JsonString(files[i].path) + ", \"error\": " + JsonString(std::string(e.what())) + "}";
+            ok = false;
+        }
+        // Lines go out in input order as soon as every earlier file is done.
+        std::lock_guard<std::mutex> lock(print_mutex);
+        if (!ok) ++failed;
+        packed[i] = ok;
+        lines[i] = std::move(line);
+        done[i] = 1;
+        for (; next_print < files.size() && done[next_print]; ++next_print) {
+            std::cout << lines[next_print] << "\n" << std::flush;
+            lines[next_print].clear();
+        }
+    });
+    PrintCacheStats(cache.get(), std::cerr);
+
+    // One file at a time, after every pack is done and the image is no longer
+    // mapped: files in the same folder share the directory sector.
+    if (opt.patch_disc) {
+        // The file the pack above wrote for each entry, named while the entries
+        // (owned by the image) are still alive.
+        std::vector<std::filesystem::path> outputs(files.size());
+        for (size_t i = 0; i < files.size(); ++i) outputs[i] = opt.out_dir / LocalName(files[i]);
+        for (auto& f : files) f.entry = nullptr;
+        opt.disc.reset();
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (!packed[i]) continue;
+            const std::string inside = PathU8(files[i].path);
+            try {
+                auto rebuilt = MapFile(outputs[i]);
+                DiscPatchResult r = PatchDiscFile(disc_path, inside, ByteView{ rebuilt->data(), rebuilt->size() }, opt.threads);
+                std::cout << "{\"file\": " << JsonString(inside) << ", \"image\": " << JsonString(disc_path)
+                          << ", \"patched\": true, \"old_size\": " << r.old_size << ", \"new_size\": " << r.new_size
+                          << ", \"sectors\": " << r.sectors << ", \"changed\": " << r.changed << "}\n";
+            } catch (const std::exception& e) {
+                std::cout << "{\"file\": " << JsonString(inside) << ", \"error\": " << JsonString(std::string(e.what())) << "}\n";
+                ++failed;
+            }
+        }
+    }
+    return failed ? 5 : 0;
+}
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t** argv) {
+    SetConsoleOutputCP(CP_UTF8);
+    Args args;
+    for (int i = 0; i < argc; ++i) args.push_back(std::filesystem::path(argv[i]).u8string());
+    return RunCli(args);
+}
+#else
+int main(int argc, char** argv) {
+    return RunCli(Args(argv, argv + argc));
+}
+#endif
@@ -1,7 +1,13 @@
 #include "pud.h"
 #include "lzss.h"
+#include "lzss_cache.h"
+#include "fileio.h"
+#include "parallel.h"
 #include <stdexcept>
 #include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
 
 static inline uint16_t u16le(const uint8_t* b) {
     return (uint16_t)(b[0] | (b[1] << 8));
@@ -20,26 +26,32 @@ static inline void p32(std::vector<uint8_t>& out, uint32_t v) {
     out.push_back((uint8_t)((v >> 24) & 0xFF));
 }
 
-PudFile ParsePUD(const std::vector<uint8_t>& b, const std::string& file_name) {
-    uint32_t size = (uint32_t)b.size();
-    uint16_t first0 = size >= 2 ? u16le(&b[0]) : 0;
-    uint16_t first1 = size >= 4 ? u16le(&b[2]) : 0;
+// Block headers through read(pos, dst, n); payloads are skipped, not read.
+template <class Read>
+static PudFile ParseHeaders(uint64_t file_size, const std::string& file_name, Read&& read) {
+    if (file_size > UINT32_MAX) throw std::runtime_error("Arquivo PUD grande demais.");
+    uint32_t size = (uint32_t)file_size;
+    uint8_t hdr[20] = {};
+    read(0, hdr, std::min<uint32_t>(size, 4));
+    uint16_t first0 = size >= 2 ? u16le(&hdr[0]) : 0;
+    uint16_t first1 = size >= 4 ? u16le(&hdr[2]) : 0;
     std::vector<PudBlock> blocks;
     uint32_t off = 4;
     int idx = 0;
     while (off + 20 <= size) {
-        uint16_t w = u16le(&b[off+0]);
-        uint16_t h = u16le(&b[off+2]);
-        uint16_t u1 = u16le(&b[off+4]);
-        uint16_t u2 = u16le(&b[off+6]);
-        uint16_t u3 = u16le(&b[off+8]);
-        uint16_t u4 = u16le(&b[off+10]);
-        uint32_t dsize = u32le(&b[off+12]);
-        uint32_t csize = u32le(&b[off+16]);
+        read(off, hdr, 20);
+        uint16_t w = u16le(&hdr[0]);
+        uint16_t h = u16le(&hdr[2]);
+        uint16_t u1 = u16le(&hdr[4]);
+        uint16_t u2 = u16le(&hdr[6]);
+        uint16_t u3 = u16le(&hdr[8]);
+        uint16_t u4 = u16le(&hdr[10]);
+        uint32_t dsize = u32le(&hdr[12]);
+        uint32_t csize = u32le(&hdr[16]);
         if (w == 0 || h == 0 || csize == 0) break;
         uint32_t data_off = off + 20;
+        if (csize > size - data_off) break;
         uint32_t data_end = data_off + csize;
-        if (data_end > size) break;
         blocks.push_back(PudBlock{ idx, off, w, h, u1,u2,u3,u4, dsize, csize, data_off, data_end });
         off = data_end;
         idx += 1;
@@ -48,32 +60,54 @@ PudFile ParsePUD(const std::vector<uint8_t>& b, const std::string& file_name) {
     return PudFile{ file_name, size, first0, first1, std::move(blocks) };
 }
 
-std::vector<uint8_t> BuildPUD_FromBlocks(const PudFile& tmpl,
-                                         const std::vector<std::vector<uint8_t>>& block_datas,
-                                         bool use_raw,
-                                         int bucket_limit,
-                                         int max_candidates,
-                                         bool lazy_matching) {
-    if (block_datas.size() != tmpl.blocks.size()) {
-        throw std::runtime_error("Número de blocos fornecidos não bate com o template.");
+PudFile ParsePUD(const std::vector<uint8_t>& b, const std::string& file_name) {
+    return ParseHeaders(b.size(), file_name, [&b](size_t pos, uint8_t* dst, size_t n) { std::memcpy(dst, b.data() + pos, n); });
+}
+
+PudFile ParsePUD(const SectorStream& s, const std::string& file_name) {
+    return ParseHeaders(s.size(), file_name, [&s](size_t pos, uint8_t* dst, size_t n) { s.read(pos, dst, n); });
+}
+
+std::filesystem::path PudBlockFileName(const std::filesystem::path& stem, int idx, bool raw) {
+    return stem.native() + std::filesystem::path(".block" + std::to_string(idx) + (raw ? ".decomp.bin" : ".bin")).native();
+}
+
+std::vector<std::vector<uint8_t>> ReadPUDBlockFiles(const PudFile& tmpl,
+                                                    const std::filesystem::path& folder,
+                                                    const std::filesystem::path& stem,
+                                                    bool raw) {
+    std::vector<std::vector<uint8_t>> blocks;
+    blocks.reserve(tmpl.blocks.size());
+    for (auto& blk : tmpl.blocks) {
+        std::filesystem::path p1 = folder / PudBlockFileName(stem, blk.idx, raw);
+        std::filesystem::path p2 = folder / ("block" + std::to_string(blk.idx) + (raw ? ".decomp.bin" : ".bin"));
+        if (std::filesystem::exists(p1)) blocks.push_back(ReadAllBytes(p1));
+        else if (std::filesystem::exists(p2)) blocks.push_back(ReadAllBytes(p2));
+        else throw std::runtime_error("Não foi encontrado arquivo para bloco " + std::to_string(blk.idx)
+                                      + ": esperado " + PudBlockFileName(stem, blk.idx, raw).u8string());
     }
+    return blocks;
+}
+
+// Emits the PUD: template block headers with each block's payload. With
+// `compressed`, the payloads are those and block_datas supplies the raw sizes.
+static std::vector<uint8_t> AssemblePUD(const PudFile& tmpl,
+                                        const std::vector<std::vector<uint8_t>>& block_datas,
+                                        const std::vector<std::vector<uint8_t>>* compressed) {
+    size_t total = 4;
+    for (size_t i = 0; i < block_datas.size(); ++i)
+        total += 20 + (compressed ? (*compressed)[i].size() : block_datas[i].size());
+
     std::vector<uint8_t> out;
+    out.reserve(total);
     p16(out, tmpl.first0);
     p16(out, tmpl.first1);
     for (size_t i = 0; i < block_datas.size(); ++i) {
         const auto& blk = tmpl.blocks[i];
         const auto& data = block_datas[i];
-        std::vector<uint8_t> comp;
-        uint32_t dsize = 0, csize = 0;
-        if (use_raw) {
-            comp = CompressLZSS_PSX(data, bucket_limit, max_candidates, lazy_matching);
-            dsize = (uint32_t)data.size();
-            csize = (uint32_t)comp.size();
-        } else {
-            comp = data;
-            dsize = blk.dsize;
-            csize = (uint32_t)comp.size();
-        }
+        const auto& comp = compressed ? (*compressed)[i] : data;
+        uint32_t dsize = compressed ? (uint32_t)data.size() : blk.dsize;
+        uint32_t csize = (uint32_t)comp.size();
         p16(out, blk.w); p16(out, blk.h);
         p16(out, blk.u1); p16(out, blk.u2); p16(out, blk.u3); p16(out, blk.u4);
         p32(out, dsize); p32(out, csize);
@@ -81,3 +115,89 @@ std::vector<uint8_t> BuildPUD_FromBlocks(const PudFile& tmpl,
     }
     return out;
 }
+
+std::vector<uint8_t> BuildPUD_FromBlocks(const PudFile& tmpl,
+                                         const std::vector<std::vector<uint8_t>>& block_datas,
+                                         bool use_raw,
+                                         const LzssParams& params,
+                                         unsigned threads,
+                                         LzssBlockCache* cache,
+                                         std::vector<LzssStats>* block_stats) {
+    if (block_datas.size() != tmpl.blocks.size()) {
+        throw std::runtime_error("Número de blocos fornecidos não bate com o template.");
+    }
+    if (block_stats) block_stats->clear();
+    if (!use_raw) return AssemblePUD(tmpl, block_datas, nullptr);
+
+    // Blocks are independent: compress them on the pool, then emit in template order.
+    std::vector<std::vector<uint8_t>> compressed(block_datas.size());
+    if (block_stats) block_stats->assign(block_datas.size(), LzssStats());
+    ParallelFor(block_datas.size(), threads, [&](size_t i) {
+        LzssStats* st = block_stats ? &(*block_stats)[i] : nullptr;
+        compressed[i] = cache ? cache->compress(block_datas[i], params, st)
+                              : CompressLZSS_PSX(block_datas[i], params, st);
+    });
+    return AssemblePUD(tmpl, block_datas, &compressed);
+}
+
+std::vector<uint8_t> BuildPUD_FromBlocksAuto(const PudFile& tmpl,
+                                             const std::vector<std::vector<uint8_t>>& raw_blocks,
+                                             const LzssAutoOptions& options,
+                                             unsigned threads,
+                                             LzssBlockCache* cache,
+                                             std::vector<LzssAutoResult>* winners) {
+    if (raw_blocks.size() != tmpl.blocks.size()) {
+        throw std::runtime_error("Número de blocos fornecidos não bate com o template.");
+    }
+    auto results = CompressLZSS_Auto(raw_blocks, options, threads, cache);
+    std::vector<std::vector<uint8_t>> compressed(results.size());
+    for (size_t i = 0; i < results.size(); ++i) compressed[i] = std::move(results[i].data);
+    auto out = AssemblePUD(tmpl, raw_blocks, &compressed);
+    if (winners) {
+        for (size_t i = 0; i < results.size(); ++i) results[i].data = std::move(compressed[i]);
+        *winners = std::move(results);
+    }
+    return out;
+}
+
+std::vector<uint8_t> BuildPUD_FromBlocksBudget(const PudFile& tmpl,
+                                               const std::vector<std::vector<uint8_t>>& raw_blocks,
+                                               const std::vector<size_t>& budgets,
+                                               const std::vector<LzssAutoProfile>& profiles,
+                                               unsigned threads,
+                                               LzssBlockCache* cache,
+                                               PudBudgetReport* report) {
+    if (raw_blocks.size() != tmpl.blocks.size()) {
+        throw std::runtime_error("Número de blocos fornecidos não bate com o template.");
+    }
+    std::vector<size_t> limits = budgets;
+    if (limits.empty())
+        for (const auto& blk : tmpl.blocks) limits.push_back(blk.csize);
+    auto results = CompressLZSS_Budget(raw_blocks, limits, profiles, threads, cache);
+
+    bool all_fit = true, in_place = true;
+    for (size_t i = 0; i < results.size(); ++i) {
+        all_fit = all_fit && results[i].fits;
+        in_place = in_place && results[i].data.size() <= tmpl.blocks[i].csize;
+    }
+    std::vector<std::vector<uint8_t>> compressed(results.size());
+    for (size_t i = 0; i < results.size(); ++i) compressed[i] = results[i].data;
+    if (in_place) {
+        std::atomic<bool> padded{true};
+        ParallelFor(compressed.size(), threads, [&](size_t i) {
+            if (!PadLZSS_PSX(compressed[i], raw_blocks[i], tmpl.blocks[i].csize)) padded = false;
+        });
+        if (!padded) {
+            in_place = false;
+            for (size_t i = 0; i < results.size(); ++i) compressed[i] = results[i].data;
+        }
+    }
+    auto out = AssemblePUD(tmpl, raw_blocks, &compressed);
+    if (report) {
+        for (size_t i = 0; i < results.size(); ++i) results[i].data = std::move(compressed[i]);
+        report->blocks = std::move(results);
+        report->all_fit = all_fit;
+        report->offsets_kept = in_place;
+    }
+    return out;
+}
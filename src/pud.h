@@ -1,7 +1,13 @@
 #pragma once
 #include <cstdint>
+#include <filesystem>
 #include <string>
 #include <vector>
+#include "disc.h"
+#include "lzss.h"
+#include "lzss_auto.h"
+
+class LzssBlockCache;
 
 struct PudBlock {
     int idx;
@@ -23,9 +29,59 @@ struct PudFile {
 };
 
 PudFile ParsePUD(const std::vector<uint8_t>& bytes, const std::string& file_name);
+// Reads only the block headers through `s` (e.g. a file inside a disc image);
+// block payloads are at [data_off, data_end) of `s`.
+PudFile ParsePUD(const SectorStream& s, const std::string& file_name);
+
+// Block file written by extraction: "<stem>.block<idx>.bin", or
+// "<stem>.block<idx>.decomp.bin" for decompressed blocks.
+std::filesystem::path PudBlockFileName(const std::filesystem::path& stem, int idx, bool raw);
+// Reads one file per template block from `folder`, trying PudBlockFileName and
+// then the same name without the stem ("block<idx>..."). Throws naming the
+// first block that has neither.
+std::vector<std::vector<uint8_t>> ReadPUDBlockFiles(const PudFile& tmpl,
+                                                    const std::filesystem::path& folder,
+                                                    const std::filesystem::path& stem,
+                                                    bool raw);
+// Rebuilds a PUD with the template's block headers. With use_raw, every block
+// is compressed first; `threads` workers do that in parallel (0 = all cores).
+// Output is identical for any thread count. A `cache` is consulted before
+// compressing each block. With `block_stats`, it receives one LzssStats per
+// block (left empty without use_raw).
 std::vector<uint8_t> BuildPUD_FromBlocks(const PudFile& tmpl,
                                          const std::vector<std::vector<uint8_t>>& block_datas,
                                          bool use_raw,
-                                         int bucket_limit = 128,
-                                         int max_candidates = 256,
-                                         bool lazy_matching = true);
+                                         const LzssParams& params = LzssParams(),
+                                         unsigned threads = 1,
+                                         LzssBlockCache* cache = nullptr,
+                                         std::vector<LzssStats>* block_stats = nullptr);
+
+// BuildPUD_FromBlocks from raw blocks with the profile chosen per block by
+// CompressLZSS_Auto; winners (if given) receives each block's result. Output
+// is identical for any thread count.
+std::vector<uint8_t> BuildPUD_FromBlocksAuto(const PudFile& tmpl,
+                                             const std::vector<std::vector<uint8_t>>& raw_blocks,
+                                             const LzssAutoOptions& options = LzssAutoOptions(),
+                                             unsigned threads = 0,
+                                             LzssBlockCache* cache = nullptr,
+                                             std::vector<LzssAutoResult>* winners = nullptr);
+
+struct PudBudgetReport {
+    std::vector<LzssBudgetResult> blocks;   // per block, data as written to the PUD
+    bool all_fit = false;
+    bool offsets_kept = false;              // every block padded to its template csize
+};
+
+// Budget mode for in-place patching: block i is compressed with the cheapest
+// profile that fits budgets[i] bytes (empty = the template's csize). When
+// every block fits its template csize, each one is padded to exactly that
+// size (PadLZSS_PSX), so all block headers and payloads keep their original
+// offsets; otherwise, or if a block cannot be padded exactly, blocks are
+// packed back to back as usual. The report tells which case happened.
+std::vector<uint8_t> BuildPUD_FromBlocksBudget(const PudFile& tmpl,
+                                               const std::vector<std::vector<uint8_t>>& raw_blocks,
+                                               const std::vector<size_t>& budgets = {},
+                                               const std::vector<LzssAutoProfile>& profiles = LzssAutoProfiles(),
+                                               unsigned threads = 0,
+                                               LzssBlockCache* cache = nullptr,
+                                               PudBudgetReport* report = nullptr);